@@ -0,0 +1,84 @@
+#include "AllocationCounter.hpp"
+
+#include <new>
+#include <cstdlib>
+
+#ifndef NDEBUG
+
+namespace {
+
+thread_local uint64_t allocations = 0;
+
+}
+
+// The replaceable allocation functions, counting each call. The array and nothrow ones go through the
+// first, the aligned ones are left to the library.
+void *operator new(std::size_t size) {
+    allocations++;
+    if (size == 0) {
+        size = 1;
+    }
+    for (;;) {
+        void *p = std::malloc(size);
+        if (p) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+uint64_t getAllocationCount() {
+    return allocations;
+}
+
+#else
+
+uint64_t getAllocationCount() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <cstdint>
+
+// Heap allocations (operator new) made until now by the calling thread. They are only counted in debug
+// builds (NDEBUG not defined): in the others it is always 0.
+uint64_t getAllocationCount();
+
+#endif // ALLOCATIONCOUNTER_HPP
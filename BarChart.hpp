@@ -2,8 +2,10 @@
 #define BARCHART_HPP
 
 #include "Starter.hpp"
-#include "CSVReader.hpp"
+#include "DataSource.hpp"
+#include "Timeline.hpp"
 #include "TextMaker.hpp"
+#include "LabelMaker.hpp"
 #include "Hud.hpp"
 #include "legend.hpp"
 
@@ -13,9 +15,7 @@ std::string shaderDir;
 
 class BarChart : public BaseProject {
     public:
-        BarChart(std::string title, std::string shaderPath, const CSVReader& csv, float gridDim = 10000);
-
-        ~BarChart();
+        BarChart(std::string title, std::string shaderPath, DataSource& csv, float gridDim = 10000);
 
         void pauseData() ;
 
@@ -23,11 +23,26 @@ class BarChart : public BaseProject {
 
         void toggleRotation();
 
+        // Line drawn when rendering without a window (see runHeadless), the last one if negative
+        void setSnapshotLine(int line);
+
     protected:
+        // Parts of the scene recorded in their own command buffers: a change to one of them
+        // (see markLayerDirty and setLayerVisible) does not record the other ones again
+        enum Layer {GROUND_LAYER, BARS_LAYER, GRID_LAYER, OVERLAY_LAYER, NUM_LAYERS};
+
+        int snapshotLine = -1;
+        Timeline timeline;
+
         char title[100]; // do not use std::string because text overlay wants a c_str but do not copy it (so can't use c_str() because temporary)
         Legend * legend;
+        LegendSnapshot legendSnapshot;
+        int labelLine;                  // line of the time shown and of the last published values
+        char timeLabel[128];
+        int timeText;                   // dynamic text of txt showing timeLabel
 
         float minHeight,
+            maxValue,
             scalingFactor,
             gridDim,
             groundX,
@@ -39,6 +54,18 @@ class BarChart : public BaseProject {
             alignas(16) glm::mat4 mvpMat;
         };
 
+        // The bars are animated by the vertex shader: between the lines stored in
+        // rows prevRow (-1 to grow from zero) and row of the chunk of SB_values bound
+        struct BarsUniformBlock {
+            alignas(16) glm::mat4 mvpMat;
+            alignas(4) int prevRow;
+            alignas(4) int row;
+            alignas(4) float blend;
+            alignas(4) float scalingFactor;
+            alignas(4) float minHeight;
+            alignas(4) int numBars;
+        };
+
         struct GlobalUniformBlock {
             alignas(16) glm::vec3 DlightDir;
             alignas(16) glm::vec3 DlightColor;
@@ -58,9 +85,19 @@ class BarChart : public BaseProject {
             glm::vec3 colour;
         };
 
+        struct VertexNormal {
+            glm::vec3 pos;
+            glm::vec3 normal;
+        };
+
+        // What changes from a bar to another: all the bars are drawn as instances of the same mesh
+        struct BarInstance {
+            glm::vec3 pos;
+            glm::vec3 colour;
+        };
+
         const char* name;
-        CSVReader csv;
-        float *visualizedValues;
+        DataSource &csv;
         // Current aspect ratio (used by the callback that resized the window
         float Ar;
 
@@ -84,24 +121,40 @@ class BarChart : public BaseProject {
         // Please note that Model objects depends on the corresponding vertex structure
         // Models
         Model<VertexColour> M_ground;
-        Model<VertexColour> * M_bars;
+        Model<VertexNormal> M_bar;
         Model<VertexLine> M_grid[2];
 
 
         // Descriptor sets
         DescriptorSet DS_ground;
-        DescriptorSet * DS_bars;
+        std::vector<DescriptorSet> DS_bars;     // one for each chunk of SB_values
+        InstanceBuffer I_bars;
+        // The whole series, line after line, one value per bar, in chunks of rows each bound whole
+        std::vector<StorageBuffer> SB_values;
+        int chunkRows;              // rows starting in each chunk, the row after them is also the first of the next one
+        int valuesChunk;            // the chunk bound by the bars layer
         DescriptorSet DSGubo;
         DescriptorSet DS_grid[2];
         
         // C++ storage for uniform variables
         UniformBlock ubo_ground;
-        UniformBlock* ubo_bars;
+        BarsUniformBlock ubo_bars;
+        std::vector<BarInstance> bars;
+        std::vector<float> lineValues;
+        // A live source: the row of SB_values of each line (line 0 in lineRows[firstLine]),
+        // the rows without a line and the last frame reading each row, not rewritten while in flight
+        std::vector<int> lineRows;
+        int firstLine;
+        std::vector<int> freeRows;
+        std::vector<uint64_t> rowReadFrame;
+        uint64_t valuesFrame;
+        int uploadedLines;
         UniformBlock ubo_grid[2];
         GlobalUniformBlock gubo;
 
 	    TextMaker txt;
 	    HudMaker hud;
+	    LabelMaker labels;
 
         // Other application parameters
         float CamH, CamRadius, CamPitch, CamYaw, targtH;
@@ -118,11 +171,37 @@ class BarChart : public BaseProject {
 
         void localCleanup() override;
 
-        void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override;
+        void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, int layer) override;
+
+        std::string getLayerName(int layer) override;
 
         void updateUniformBuffer(uint32_t currentImage) override;
 
-        glm::mat4 getWorldMatrixBar(float height);
+        // What the ground shows may depend on the view (see BarChartMap): called every frame with the
+        // transform of the ground and the position of the camera
+        virtual void updateGround(uint32_t currentImage, const glm::mat4 &ViewPrj, glm::vec3 camPos) {}
+
+        void afterFrame() override;
+
+        void onTextureReady(Texture *texture) override;
+
+        void initBarsVertexDescriptor();
+
+        void initValues();
+
+        void initLegend(const std::vector<std::string> &names, const std::vector<glm::vec3> &colors);
+
+        void initLabels(const std::vector<std::string> &names, glm::vec3 top);
+
+        void uploadNewLines(int dropped);
+
+        int takeFreeRow();
+
+        void createGrid();
+
+        void rescale();
+
+        int getRow(int line);
 
 
 };
@@ -169,17 +248,19 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
 // Example:
 
 // MAIN ! 
-BarChart::BarChart(std::string title, std::string shaderPath, const CSVReader& csv, float gridDim) : BaseProject(), csv(csv) {
+BarChart::BarChart(std::string title, std::string shaderPath, DataSource& csv, float gridDim) : BaseProject(), csv(csv) {
     strcpy(this->title, title.c_str());
     shaderDir = shaderPath;
     name = "Bar Chart";
-    M_bars = new Model<VertexColour>[csv.getNumVariables()-1];
-    DS_bars = new DescriptorSet[csv.getNumVariables()-1];
-    ubo_bars = new UniformBlock[csv.getNumVariables()-1];
+    bars.resize(csv.getNumVariables()-1);
 
     minHeight = 0.001f;
     int excludeCol[1] = {0}; 
-    scalingFactor = 20/csv.getMaxValue(excludeCol, 1);//0.0001;
+    maxValue = csv.getMaxValue(excludeCol, 1);
+    // a live source may start with zeros only
+    if(maxValue <= 0)
+        maxValue = 1;
+    scalingFactor = 20/maxValue;//0.0001;
     printf("scaling: %f", scalingFactor);
     this->gridDim = gridDim;
     gridLinesWidth = 0.1f;
@@ -193,14 +274,6 @@ BarChart::BarChart(std::string title, std::string shaderPath, const CSVReader& c
     };
 }
 
-BarChart::~BarChart() {
-    // Deallocate the memory used by the models array
-    delete[] M_bars;
-    delete[] DS_bars;
-    delete[] ubo_bars;
-}
-
-
 int height;
 int width;
 // Here you set the main application parameters
@@ -212,10 +285,13 @@ void BarChart::setWindowParameters() {
     windowResizable = GLFW_TRUE;
     initialBackgroundColor = {0.0f, 0.005f, 0.01f, 1.0f};
     
-    // Descriptor pool sizes
+    // Descriptor pool sizes (further pools are added when more descriptors are needed)
     uniformBlocksInPool = 200;
     texturesInPool = 100;
+    storageBuffersInPool = 10;
     setsInPool = 200;
+
+    numLayers = NUM_LAYERS;
     
     Ar = (float)windowWidth / (float)windowHeight;
     height = windowHeight;
@@ -233,10 +309,12 @@ void BarChart::onWindowResize(int w, int h) {
 // Here you load and setup all your Vulkan Models and Texutures.
 // Here you also create your Descriptor set layouts and load the shaders for the pipelines
 void BarChart::localInit() {
-    legend = &Legend::getInstance(window);
+    // the legend has a window of its own
+    legend = headless ? nullptr : &Legend::getInstance(window);
 
     DSL_bar.init(this, {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
+                {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
             });
     DSL_grid.init(this, {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
@@ -255,13 +333,7 @@ void BarChart::localInit() {
     DSLGubo.init(this, {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS}
         });
-    VD_bar.init(this, {
-                {0, sizeof(VertexColour), VK_VERTEX_INPUT_RATE_VERTEX}
-            }, {
-                {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexColour, pos), sizeof(glm::vec3), POSITION},
-                {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexColour, normal), sizeof(glm::vec3), NORMAL},
-                {0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexColour, colour), sizeof(glm::vec3), COLOR}
-            });
+    initBarsVertexDescriptor();
     VD_line.init(this, {
                 {0, sizeof(VertexLine), VK_VERTEX_INPUT_RATE_VERTEX}
             }, {
@@ -313,7 +385,7 @@ void BarChart::localInit() {
 
     P_ground.init(this, &VD_ground, shaderDir + "ShaderBar.vert.spv", shaderDir + "ShaderBar.frag.spv", {&DSL_ground, &DSLGubo});
 
-    P_bar.init(this, &VD_bar, shaderDir + "ShaderBar.vert.spv", shaderDir + "ShaderBar.frag.spv", {&DSL_bar, &DSLGubo});
+    P_bar.init(this, &VD_bar, shaderDir + "ShaderBarInstanced.vert.spv", shaderDir + "ShaderBar.frag.spv", {&DSL_bar, &DSLGubo});
 
     P_grid.init(this, &VD_line, shaderDir + "ShaderLine.vert.spv", shaderDir + "ShaderLine.frag.spv", {&DSL_grid});
 
@@ -327,28 +399,7 @@ void BarChart::localInit() {
 
     float start = -groundX + 1;
 
-    // create grid
-    int tmp[1] = {0};
-    int numLines = csv.getMaxValue(tmp, 1) / gridDim + 1;
-    for(int i=0; i <= numLines; i++) {
-        M_grid[0].vertices.push_back({{start-1, i*gridDim*scalingFactor+minHeight, 0}, {1, 1, 1}});
-        M_grid[0].vertices.push_back({{-start+1, i*gridDim*scalingFactor+minHeight, 0}, {1, 1, 1}});
-        printf("%f\n", i*gridDim*scalingFactor);
-    }
-    for(int i=0; i <= numLines*2; i++) {
-        M_grid[0].indices.push_back(i);
-    }
-    M_grid[0].initMesh(this, &VD_line);
-
-    for(int i=0; i <= numLines; i++) {
-        M_grid[1].vertices.push_back({{0, i*gridDim*scalingFactor+minHeight, -1.5}, {1, 1, 1}});
-        M_grid[1].vertices.push_back({{0, i*gridDim*scalingFactor+minHeight, 1.5}, {1, 1, 1}});
-        printf("%f\n", i*gridDim*scalingFactor);
-    }
-    for(int i=0; i <= numLines*2; i++) {
-        M_grid[1].indices.push_back(i);
-    }
-    M_grid[1].initMesh(this, &VD_line);
+    createGrid();
     
     // Creates a mesh with direct enumeration of vertices and indices
     
@@ -368,59 +419,63 @@ void BarChart::localInit() {
     
     for (int i = 0; i < csv.getNumVariables()-1; i++) {
         names.push_back(csv.getVariableNames()[i+1]);
-        //create a parallelepiped of a random color
+        //place a bar of a random color
         float r = (float)rand() / (float)RAND_MAX;
         float g = (float)rand() / (float)RAND_MAX;
         float b = (float)rand() / (float)RAND_MAX;
         colors.push_back(glm::vec3(r, g, b));
-        // add the vertices putting position, normal (replicated vertices) and color
-        M_bars[i].vertices = {
-            // bottom face
-            {{start+i,0,-0.5}, {0, -1, 0}, {r,g,b}},
-            {{start+i,0,0.5}, {0, -1, 0}, {r,g,b}},
-            {{start+i+1,0,-0.5}, {0, -1, 0}, {r,g,b}},
-            {{start+i+1,0,0.5}, {0, -1, 0}, {r,g,b}},
-            // top face
-            {{start+i,1,-0.5}, {0, 1, 0}, {r,g,b}},
-            {{start+i,1,0.5}, {0, 1, 0}, {r,g,b}},
-            {{start+i+1,1,-0.5}, {0, 1, 0}, {r,g,b}},
-            {{start+i+1,1,0.5}, {0, 1, 0}, {r,g,b}},
-            // left face
-            {{start+i,0,-0.5}, {-1, 0, 0}, {r,g,b}},
-            {{start+i,0,0.5}, {-1, 0, 0}, {r,g,b}},
-            {{start+i,1,-0.5}, {-1, 0, 0}, {r,g,b}},
-            {{start+i,1,0.5}, {-1, 0, 0}, {r,g,b}},
-            // right face
-            {{start+i+1,0,-0.5}, {1, 0, 0}, {r,g,b}},
-            {{start+i+1,0,0.5}, {1, 0, 0}, {r,g,b}},
-            {{start+i+1,1,-0.5}, {1, 0, 0}, {r,g,b}},
-            {{start+i+1,1,0.5}, {1, 0, 0}, {r,g,b}},
-            // front face
-            {{start+i,0,0.5}, {0, 0, 1}, {r,g,b}},
-            {{start+i+1,0,0.5}, {0, 0, 1}, {r,g,b}},
-            {{start+i,1,0.5}, {0, 0, 1}, {r,g,b}},
-            {{start+i+1,1,0.5}, {0, 0, 1}, {r,g,b}},
-            // back face
-            {{start+i,0,-0.5}, {0, 0, -1}, {r,g,b}},
-            {{start+i+1,0,-0.5}, {0, 0, -1}, {r,g,b}},
-            {{start+i,1,-0.5}, {0, 0, -1}, {r,g,b}},
-            {{start+i+1,1,-0.5}, {0, 0, -1}, {r,g,b}}
-        };
-
-        // add the indices
-        M_bars[i].indices = {
-            0, 1, 2, 1, 3, 2, // bottom
-            4, 5, 6, 5, 7, 6, // top
-            8, 9, 10, 9, 11, 10, // left
-            12, 13, 14, 13, 15, 14, // right
-            16, 17, 18, 17, 19, 18, // front
-            20, 21, 22, 21, 23, 22 // back
-        };
-        M_bars[i].initMesh(this, &VD_bar);
+        bars[i] = {{start+i, 0, 0}, {r, g, b}};
     }
 
-	txt.init(this, &demoText);
+    // unit parallelepiped shared by all the bars, each instance moves it and scales its height
+    M_bar.vertices = {
+        // bottom face
+        {{0,0,-0.5}, {0, -1, 0}},
+        {{0,0,0.5}, {0, -1, 0}},
+        {{1,0,-0.5}, {0, -1, 0}},
+        {{1,0,0.5}, {0, -1, 0}},
+        // top face
+        {{0,1,-0.5}, {0, 1, 0}},
+        {{0,1,0.5}, {0, 1, 0}},
+        {{1,1,-0.5}, {0, 1, 0}},
+        {{1,1,0.5}, {0, 1, 0}},
+        // left face
+        {{0,0,-0.5}, {-1, 0, 0}},
+        {{0,0,0.5}, {-1, 0, 0}},
+        {{0,1,-0.5}, {-1, 0, 0}},
+        {{0,1,0.5}, {-1, 0, 0}},
+        // right face
+        {{1,0,-0.5}, {1, 0, 0}},
+        {{1,0,0.5}, {1, 0, 0}},
+        {{1,1,-0.5}, {1, 0, 0}},
+        {{1,1,0.5}, {1, 0, 0}},
+        // front face
+        {{0,0,0.5}, {0, 0, 1}},
+        {{1,0,0.5}, {0, 0, 1}},
+        {{0,1,0.5}, {0, 0, 1}},
+        {{1,1,0.5}, {0, 0, 1}},
+        // back face
+        {{0,0,-0.5}, {0, 0, -1}},
+        {{1,0,-0.5}, {0, 0, -1}},
+        {{0,1,-0.5}, {0, 0, -1}},
+        {{1,1,-0.5}, {0, 0, -1}}
+    };
+
+    // add the indices
+    M_bar.indices = {
+        0, 1, 2, 1, 3, 2, // bottom
+        4, 5, 6, 5, 7, 6, // top
+        8, 9, 10, 9, 11, 10, // left
+        12, 13, 14, 13, 15, 14, // right
+        16, 17, 18, 17, 19, 18, // front
+        20, 21, 22, 21, 23, 22 // back
+    };
+    M_bar.initMesh(this, &VD_bar);
+
+	txt.init(this, &demoText, sizeof(timeLabel));
+	timeText = txt.addDynamicText(sizeof(timeLabel));
 	hud.init(this);
+	initLabels(names, {0.5f, 0.0f, 0.0f});
     
     // Create the textures
     // The second parameter is the file name
@@ -432,11 +487,13 @@ void BarChart::localInit() {
     CamPitch = 0.53f;
     CamYaw = 2.7f;
 
-    visualizedValues = (float *)malloc((csv.getNumVariables()-1)*sizeof(float));
-    legend->setLegend(names, colors);
+    initValues();
+    initLegend(names, colors);
 
     _BP_Ref = this;
-    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    if (!headless) {
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    }
 }
 	
 // Here you create your pipelines and Descriptor Sets!
@@ -460,10 +517,15 @@ void BarChart::pipelinesAndDescriptorSetsInit() {
     
 
     P_bar.create();
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        DS_bars[i].init(this, &DSL_bar, {
-                {0, UNIFORM, sizeof(UniformBlock), nullptr}
-            });
+    for (size_t c = 0; c < DS_bars.size(); c++) {
+        DS_bars[c].init(this, &DSL_bar, {
+                    {0, UNIFORM, sizeof(BarsUniformBlock), nullptr},
+                    {1, STORAGE, 0, nullptr, &SB_values[c]}
+                });
+    }
+    I_bars.init(this, bars.size() * sizeof(BarInstance));
+    for (size_t i = 0; i < swapChainImages.size(); i++) {
+        I_bars.map(i, bars.data(), bars.size() * sizeof(BarInstance));
     }
 
 	P_grid.create(VK_PRIMITIVE_TOPOLOGY_LINE_LIST, gridLinesWidth);
@@ -476,6 +538,7 @@ void BarChart::pipelinesAndDescriptorSetsInit() {
 
     txt.pipelinesAndDescriptorSetsInit();
     hud.pipelinesAndDescriptorSetsInit();
+    labels.pipelinesAndDescriptorSetsInit();
 }
 
 // Here you destroy your pipelines and Descriptor Sets!
@@ -491,13 +554,15 @@ void BarChart::pipelinesAndDescriptorSetsCleanup() {
     DS_grid[1].cleanup();
 
     P_bar.cleanup();
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        DS_bars[i].cleanup();
+    for (DescriptorSet &DS : DS_bars) {
+        DS.cleanup();
     }
+    I_bars.cleanup();
     DSGubo.cleanup();
 
 	txt.pipelinesAndDescriptorSetsCleanup();
 	hud.pipelinesAndDescriptorSetsCleanup();
+	labels.pipelinesAndDescriptorSetsCleanup();
 }
 
 // Here you destroy all the Models, Texture and Desc. Set Layouts you created!
@@ -507,8 +572,9 @@ void BarChart::pipelinesAndDescriptorSetsCleanup() {
 void BarChart::localCleanup() {
     // Cleanup models
     M_ground.cleanup();
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        M_bars[i].cleanup();
+    M_bar.cleanup();
+    for (StorageBuffer &SB : SB_values) {
+        SB.cleanup();
     }
     M_grid[0].cleanup();
     M_grid[1].cleanup();
@@ -524,6 +590,7 @@ void BarChart::localCleanup() {
     P_bar.destroy();
     P_grid.destroy();
 
+	labels.localCleanup();
 	txt.localCleanup();
 	hud.localCleanup();
 }
@@ -531,54 +598,69 @@ void BarChart::localCleanup() {
 // Here it is the creation of the command buffer:
 // You send to the GPU all the objects you want to draw,
 // with their buffers and textures
-void BarChart::populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
-    
-    // binds the pipeline
-    P_ground.bind(commandBuffer);
-    DSGubo.bind(commandBuffer, P_ground, 1, currentImage);
-    // For a pipeline object, this command binds the corresponing pipeline to the command buffer passed in its parameter
-
-    // binds the data set
-    DS_ground.bind(commandBuffer, P_ground, 0, currentImage);
-    // For a Dataset object, this command binds the corresponing dataset
-    // to the command buffer and pipeline passed in its first and second parameters.
-    // The third parameter is the number of the set being bound
-    // As described in the Vulkan tutorial, a different dataset is required for each image in the swap chain.
-    // This is done automatically in file Starter.hpp, however the command here needs also the index
-    // of the current image in the swap chain, passed in its last parameter
-
-    // binds the model
-    M_ground.bind(commandBuffer);
-    // For a Model object, this command binds the corresponing index and vertex buffer
-    // to the command buffer passed in its parameter
-
-    // record the drawing command in the command buffer
-    vkCmdDrawIndexed(commandBuffer,
-            static_cast<uint32_t>(M_ground.indices.size()), 1, 0, 0, 0);
-    // the second parameter is the number of indexes to be drawn. For a Model object,
-    // this can be retrieved with the .indices.size() method.
-
-
-    P_bar.bind(commandBuffer);
-    DSGubo.bind(commandBuffer, P_bar, 1, currentImage);
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        DS_bars[i].bind(commandBuffer, P_bar, 0, currentImage);
-        M_bars[i].bind(commandBuffer);
-        vkCmdDrawIndexed(commandBuffer,
-                static_cast<uint32_t>(M_bars[i].indices.size()), 1, 0, 0, 0);
+void BarChart::populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, int layer) {
+    switch (layer) {
+    case GROUND_LAYER:
+        // binds the pipeline
+        P_ground.bind(commandBuffer);
+        DSGubo.bind(commandBuffer, P_ground, 1, currentImage);
+        // For a pipeline object, this command binds the corresponing pipeline to the command buffer passed in its parameter
+
+        // binds the data set
+        DS_ground.bind(commandBuffer, P_ground, 0, currentImage);
+        // For a Dataset object, this command binds the corresponing dataset
+        // to the command buffer and pipeline passed in its first and second parameters.
+        // The third parameter is the number of the set being bound
+        // As described in the Vulkan tutorial, a different dataset is required for each image in the swap chain.
+        // This is done automatically in file Starter.hpp, however the command here needs also the index
+        // of the current image in the swap chain, passed in its last parameter
+
+        // binds the model
+        M_ground.bind(commandBuffer);
+        // For a Model object, this command binds the corresponing index and vertex buffer
+        // to the command buffer passed in its parameter
+
+        // record the drawing command in the command buffer
+        drawIndexed(commandBuffer, static_cast<uint32_t>(M_ground.indices.size()));
+        // the second parameter is the number of indexes to be drawn. For a Model object,
+        // this can be retrieved with the .indices.size() method.
+        break;
+
+    case BARS_LAYER:
+        // all the bars at once: one instance of M_bar each
+        P_bar.bind(commandBuffer);
+        DSGubo.bind(commandBuffer, P_bar, 1, currentImage);
+        DS_bars[valuesChunk].bind(commandBuffer, P_bar, 0, currentImage);
+        M_bar.bind(commandBuffer);
+        I_bars.bind(commandBuffer, 1, currentImage);
+        drawIndexed(commandBuffer,
+                static_cast<uint32_t>(M_bar.indices.size()), static_cast<uint32_t>(bars.size()));
+        // their names, over them
+        labels.populateCommandBuffer(commandBuffer, currentImage, DS_bars[valuesChunk]);
+        break;
+
+    case GRID_LAYER:
+        P_grid.bind(commandBuffer);
+        DS_grid[0].bind(commandBuffer, P_grid, 0, currentImage);
+        M_grid[0].bind(commandBuffer);
+        drawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[0].indices.size()));
+
+        DS_grid[1].bind(commandBuffer, P_grid, 0, currentImage);
+        M_grid[1].bind(commandBuffer);
+        drawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[1].indices.size()));
+        break;
+
+    case OVERLAY_LAYER:
+        txt.populateCommandBuffer(commandBuffer, currentImage, 0);
+        txt.populateDynamicCommandBuffer(commandBuffer, currentImage);
+        hud.populateCommandBuffer(commandBuffer, currentImage, 0);
+        break;
     }
+}
 
-    P_grid.bind(commandBuffer);
-    DS_grid[0].bind(commandBuffer, P_grid, 0, currentImage);
-    M_grid[0].bind(commandBuffer);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[0].indices.size()), 1, 0, 0, 0);
-
-    DS_grid[1].bind(commandBuffer, P_grid, 0, currentImage);
-    M_grid[1].bind(commandBuffer);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[1].indices.size()), 1, 0, 0, 0);
-	
-    txt.populateCommandBuffer(commandBuffer, currentImage, 0);
-    hud.populateCommandBuffer(commandBuffer, currentImage, 0);
+std::string BarChart::getLayerName(int layer) {
+    const char *names[NUM_LAYERS] = {"ground", "bars", "grid", "overlay"};
+    return names[layer];
 }
 
 bool isAutoRotationEnabled = false;
@@ -596,11 +678,15 @@ void BarChart::toggleRotation(){
     isAutoRotationEnabled = !isAutoRotationEnabled;
 }
 
+void BarChart::setSnapshotLine(int line) {
+    snapshotLine = line;
+}
+
 // Here is where you update the uniforms.
 // Very likely this will be where you will be writing the logic of your application.
 void BarChart::updateUniformBuffer(uint32_t currentImage) {
     // Standard procedure to quit when the ESC key is pressed
-    if(glfwGetKey(window, GLFW_KEY_ESCAPE)) {
+    if(!headless && glfwGetKey(window, GLFW_KEY_ESCAPE)) {
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
     
@@ -644,6 +730,49 @@ void BarChart::updateUniformBuffer(uint32_t currentImage) {
         wasPausePressed = false;
     }
 
+    // M prints how the GPU memory blocks are used
+    static bool wasMemoryStatsPressed = false;
+    bool isMemoryStatsPressed = !headless && glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (isMemoryStatsPressed && !wasMemoryStatsPressed) {
+        printMemoryStats();
+    }
+    wasMemoryStatsPressed = isMemoryStatsPressed;
+
+    // G shows or hides the grid, without recording the rest of the scene again
+    static bool wasGridPressed = false;
+    bool isGridPressed = !headless && glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (isGridPressed && !wasGridPressed) {
+        setLayerVisible(GRID_LAYER, !isLayerVisible(GRID_LAYER));
+    }
+    wasGridPressed = isGridPressed;
+
+    // [ and ] halve or double the speed of the animation, , and . step one line back or forward
+    static int wasTimelinePressed = 0;
+    int isTimelinePressed = 0;
+    const int timelineKeys[] = {GLFW_KEY_LEFT_BRACKET, GLFW_KEY_RIGHT_BRACKET, GLFW_KEY_COMMA, GLFW_KEY_PERIOD};
+    for (int key : timelineKeys) {
+        if (!headless && glfwGetKey(window, key) == GLFW_PRESS) {
+            isTimelinePressed = key;
+        }
+    }
+    if (isTimelinePressed != wasTimelinePressed) {
+        switch (isTimelinePressed) {
+        case GLFW_KEY_LEFT_BRACKET:
+            timeline.setSpeed(std::max(timeline.getSpeed() / 2, 1.0f / 16));
+            break;
+        case GLFW_KEY_RIGHT_BRACKET:
+            timeline.setSpeed(std::min(timeline.getSpeed() * 2, 16.0f));
+            break;
+        case GLFW_KEY_COMMA:
+            timeline.seek(timeline.getLine() - 1);
+            break;
+        case GLFW_KEY_PERIOD:
+            timeline.seek(timeline.getLine() + 1);
+            break;
+        }
+    }
+    wasTimelinePressed = isTimelinePressed;
+
     // Parameters
     // Camera FOV-y, Near Plane and Far Plane
     const float FOVy = glm::radians(90.0f);
@@ -672,6 +801,15 @@ void BarChart::updateUniformBuffer(uint32_t currentImage) {
 
     if (CamRadius>50.0f)
         CamRadius = 50.0f;
+
+    // a benchmark always draws the same frames: the camera goes around the chart, closer and farther
+    if (benchmarking) {
+        static float benchmarkTime = 0.0f;
+        benchmarkTime += deltaT;
+        CamYaw = 2.7f + cameraSpeed * benchmarkTime;
+        CamRadius = 13.0f + 6.0f * sin(0.4f * benchmarkTime);
+        CamPitch = 0.53f + 0.3f * sin(0.25f * benchmarkTime);
+    }
     // print the controls (m variable values)
         // std::cout << m.x << " " << m.y << " " << m.z << std::endl;
         // std::cout << r.x << " " << r.y << " " << r.z << std::endl;
@@ -716,52 +854,54 @@ void BarChart::updateUniformBuffer(uint32_t currentImage) {
     // the second parameter is the pointer to the C++ data structure to transfer to the GPU
     // the third parameter is its size
     // the fourth parameter is the location inside the descriptor set of this uniform block
-    static float time = 0, animationTime = 0;
-    animationTime += deltaT;
-    time += deltaT;
-    static int line = 0;
-
-    float valueTime = 0.5f;
-    std::vector<float> values;
-
-    
-    // every valueTime seconds, we change the line of the csv file to be read and therefore update the bars
-    
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        float prevValue = line==0?0:std::stof(csv.getLine(line-1)[i+1]);
-        float value = std::stof(csv.getLine(line)[i+1]);
-
-        if (!isPauseEnabled){
-            visualizedValues[i] = prevValue +
-            (value - prevValue) * (animationTime / valueTime);
-        }
-        else
-        {
-            visualizedValues[i] = prevValue;
-        }
-        
-        values.push_back(visualizedValues[i]);
+    updateGround(currentImage, ubo_ground.mvpMat, camPos);
+
+    // take in the lines received by a live source, the oldest ones may have been dropped meanwhile
+    int dropped = csv.update();
+    timeline.dropLines(dropped);
+    uploadNewLines(dropped);
+    // a live source stays on its last line until a new one arrives
+    timeline.setNumLines(csv.getNumLines(), !csv.isLive());
+
+    // an export or a benchmark plays the whole animation, a snapshot shows a single line fully grown
+    bool playing = exporting || benchmarking;
+    if (headless && !playing) {
+        timeline.seek(snapshotLine < 0 ? csv.getNumLines() - 1 : snapshotLine);
+    } else {
+        timeline.setPaused(isPauseEnabled && !playing);
+        timeline.advance(deltaT);
     }
-    
-    if(time >= valueTime) {
-        time = 0;
-        if(!isPauseEnabled)
-            line++;
-        animationTime = 0;
-        if(line >= csv.getNumLines())
-            line = 0;
+    int line = timeline.getLine();
+
+    // the heights are interpolated by the vertex shader, from the previous line to the current one:
+    // both are in the chunk of the values bound, another one is bound when they leave it
+    int prevRow = line==0 ? -1 : getRow(line-1);
+    int row = getRow(line);
+    int chunk = std::max(prevRow, 0) / chunkRows;
+    if (chunk != valuesChunk) {
+        valuesChunk = chunk;
+        markLayerDirty(BARS_LAYER);
     }
-
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        World = getWorldMatrixBar(visualizedValues[i]);
-        ubo_bars[i].mvpMat = Prj * View * World;
-        DS_bars[i].map(currentImage, &ubo_bars[i], sizeof(ubo_bars[i]), 0);
+    ubo_bars.mvpMat = Prj * View;
+    ubo_bars.prevRow = prevRow < 0 ? -1 : prevRow - chunk * chunkRows;
+    ubo_bars.row = row - chunk * chunkRows;
+    ubo_bars.blend = timeline.getBlend();
+    ubo_bars.scalingFactor = scalingFactor;
+    ubo_bars.minHeight = minHeight;
+    ubo_bars.numBars = bars.size();
+    DS_bars[valuesChunk].map(currentImage, &ubo_bars, sizeof(ubo_bars), 0);
+    if (csv.isLive()) {
+        if (prevRow >= 0) {
+            rowReadFrame[prevRow] = valuesFrame;
+        }
+        rowReadFrame[row] = valuesFrame;
+        valuesFrame++;
     }
-    // printf("\ntime: %f\nline: %d\n", time, line);
     // printf("cam pitch: %f\ncam yaw: %f\n", CamPitch, CamYaw);
 
     txt.update(currentImage, height, width);
     hud.update(currentImage, height, width);
+    labels.update(currentImage, height, width);
 
     if(camPos[2] > 0)
         World = glm::translate(glm::mat4(1), glm::vec3(0, 0, -groundZ)) * glm::mat4(1);
@@ -777,17 +917,221 @@ void BarChart::updateUniformBuffer(uint32_t currentImage) {
     ubo_grid[0].mvpMat = Prj * View * World;
     DS_grid[1].map(currentImage, &ubo_grid[0], sizeof(ubo_grid[0]), 0);
 
-    char str[100];
-    sprintf(str, "line: %d; time: %s", line, csv.getLine(line)[0].c_str());
-    legend->setTime(str);
-    legend->setValues(values);
-    legend->mainLoop();
+    // the time of the line being reached is written under the title; the legend shows it with the values,
+    // written in place in the preallocated snapshot
+    if(line != labelLine || dropped > 0) {
+        snprintf(timeLabel, sizeof(timeLabel), "line: %d; time: %s", line, csv.getLabel(line).c_str());
+        txt.setDynamicText(timeText, timeLabel, 0, FontSizes[1]);
+        if(legend) {
+            LegendValues &next = legendSnapshot.back();
+            for (int i = 0; i < (int)next.values.size(); i++) {
+                next.values[i] = csv.getValue(line, i+1);
+            }
+            memcpy(next.time, timeLabel, sizeof(next.time));
+            legendSnapshot.publish();
+        }
+        labelLine = line;
+    }
+}
+
+// The legend is drawn outside of the frames, at its own rate
+void BarChart::afterFrame() {
+    if(legend) {
+        ScopedTimer timer("legend");
+        legend->refresh();
+    }
+}
+
+// The hud is left out of the overlay until its texture is loaded
+void BarChart::onTextureReady(Texture *texture) {
+    if (texture == &hud.T) {
+        markLayerDirty(OVERLAY_LAYER);
+    }
+}
+
+// Every slot of the snapshot gets a value per bar now: the legend updates do not allocate
+void BarChart::initLegend(const std::vector<std::string> &names, const std::vector<glm::vec3> &colors) {
+    labelLine = -1;
+    if (!legend) {
+        return;
+    }
+    for (int s = 0; s < 3; s++) {
+        legendSnapshot.slot(s).values.assign(csv.getNumVariables()-1, 0.0f);
+        legendSnapshot.slot(s).time[0] = '\0';
+    }
+    legend->setLegend(names, colors);
+    legend->setSnapshot(&legendSnapshot);
+}
+
+// The name of each bar over it, following its top. top: the middle of the top of the unit bar
+void BarChart::initLabels(const std::vector<std::string> &names, glm::vec3 top) {
+    // in pixels of the window, whatever its size
+    labels.init(this, &txt, &DSL_bar, 18.0f);
+    for (size_t i = 0; i < bars.size(); i++) {
+        labels.addLabel(names[i].c_str(), bars[i].pos + top, i);
+    }
 }
 
-glm::mat4 BarChart::getWorldMatrixBar(float height) {
-    height = height * scalingFactor + minHeight;
-    glm::mat4 World =  glm::scale(glm::mat4(1), glm::vec3(1.f, height, 1.f));
-    return World;
+// Uploads the series once: one row per line, one value per bar, in chunks no larger than the GPU binds.
+// Each chunk repeats the first row of the next one, so the two rows drawn are always in the same chunk.
+// A live source gets all the rows it can keep, in a single chunk, filled as its lines arrive, and one
+// spare row for each one the frames in flight may still read.
+void BarChart::initValues() {
+    int numBars = csv.getNumVariables()-1;
+    int numRows = csv.getMaxLines() + (csv.isLive() ? 2 * MAX_FRAMES_IN_FLIGHT : 0);
+    VkMemoryPropertyFlags properties = csv.isLive() ?
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    VkDeviceSize rowSize = (VkDeviceSize)numBars * sizeof(float);
+    VkDeviceSize size = (VkDeviceSize)numRows * rowSize;
+    VkDeviceSize maxSize = maxStorageBufferSize(properties);
+    int maxChunkRows = (int)std::min(maxSize / rowSize, (VkDeviceSize)numRows);
+    if (size > memoryHeapSize(properties)) {
+        throw std::runtime_error("failed to load the values: " + std::to_string(numRows) + " lines of " +
+                                 std::to_string(numBars) + " bars take " + std::to_string(size >> 20) +
+                                 " MB, more than the memory of the GPU!");
+    }
+    if (numRows > maxChunkRows && (csv.isLive() || maxChunkRows < 2)) {
+        throw std::runtime_error("failed to load the values: " + std::to_string(csv.isLive() ? numRows : 2) +
+                                 " lines of " + std::to_string(numBars) + " bars take more than the " +
+                                 std::to_string(maxSize >> 20) + " MB the GPU binds at most!");
+    }
+    chunkRows = numRows <= maxChunkRows ? numRows : maxChunkRows-1;
+    int numChunks = numRows <= maxChunkRows ? 1 : (numRows-2) / chunkRows + 1;
+    SB_values.resize(numChunks);
+    DS_bars.resize(numChunks);
+    std::vector<float> values;
+    for (int c = 0; c < numChunks; c++) {
+        int first = c * chunkRows;
+        int rows = std::min(chunkRows+1, numRows - first);
+        values.assign((size_t)rows * numBars, 0.f);
+        for (int l = first; l < std::min(first + rows, csv.getNumLines()); l++) {
+            for (int i = 0; i < numBars; i++) {
+                values[(size_t)(l - first) * numBars + i] = csv.getValue(l, i+1);
+            }
+        }
+        SB_values[c].init(this, values.size() * sizeof(float), values.data(), csv.isLive());
+    }
+    valuesChunk = 0;
+    lineValues.resize(numBars);
+    uploadedLines = csv.getNumLines();
+    if (csv.isLive()) {
+        // the lines already received in the first rows, the others free (taken from the back, in order)
+        lineRows.resize(csv.getMaxLines());
+        for (int l = 0; l < uploadedLines; l++) {
+            lineRows[l] = l;
+        }
+        firstLine = 0;
+        freeRows.clear();
+        for (int r = numRows-1; r >= uploadedLines; r--) {
+            freeRows.push_back(r);
+        }
+        // the first frame has not read anything yet
+        valuesFrame = MAX_FRAMES_IN_FLIGHT;
+        rowReadFrame.assign(numRows, 0);
+    }
+}
+
+// The rows of the dropped lines of a live source are freed, the new lines take rows
+// no frame in flight reads anymore
+void BarChart::uploadNewLines(int dropped) {
+    for (int d = std::min(dropped, uploadedLines); d > 0; d--) {
+        freeRows.push_back(lineRows[firstLine]);
+        firstLine = (firstLine + 1) % csv.getMaxLines();
+    }
+    uploadedLines = std::max(uploadedLines - dropped, 0);
+    if (uploadedLines < csv.getNumLines()) {
+        rescale();
+    }
+    for (; uploadedLines < csv.getNumLines(); uploadedLines++) {
+        int row = takeFreeRow();
+        lineRows[(firstLine + uploadedLines) % csv.getMaxLines()] = row;
+        for (int i = 0; i < (int)lineValues.size(); i++) {
+            lineValues[i] = csv.getValue(uploadedLines, i+1);
+        }
+        SB_values[0].write((size_t)row * lineValues.size() * sizeof(float),
+                        lineValues.data(), lineValues.size() * sizeof(float));
+    }
+}
+
+// The frames before the last MAX_FRAMES_IN_FLIGHT ones are complete (their fences were waited):
+// the others read at most two rows each, so one of the spare rows is always free
+int BarChart::takeFreeRow() {
+    for (int i = (int)freeRows.size()-1; i >= 0; i--) {
+        int row = freeRows[i];
+        if (rowReadFrame[row] + MAX_FRAMES_IN_FLIGHT <= valuesFrame) {
+            freeRows[i] = freeRows.back();
+            freeRows.pop_back();
+            return row;
+        }
+    }
+    throw std::runtime_error("failed to find a free row for the values!");
+}
+
+// Lines every gridDim on the two sides of the chart, up to maxValue
+void BarChart::createGrid() {
+    int numLines = maxValue / gridDim + 1;
+    for(int i=0; i <= numLines; i++) {
+        M_grid[0].vertices.push_back({{-groundX, i*gridDim*scalingFactor+minHeight, 0}, {1, 1, 1}});
+        M_grid[0].vertices.push_back({{groundX, i*gridDim*scalingFactor+minHeight, 0}, {1, 1, 1}});
+    }
+    for(int i=0; i <= numLines*2; i++) {
+        M_grid[0].indices.push_back(i);
+    }
+    M_grid[0].initMesh(this, &VD_line);
+
+    for(int i=0; i <= numLines; i++) {
+        M_grid[1].vertices.push_back({{0, i*gridDim*scalingFactor+minHeight, -groundZ}, {1, 1, 1}});
+        M_grid[1].vertices.push_back({{0, i*gridDim*scalingFactor+minHeight, groundZ}, {1, 1, 1}});
+    }
+    for(int i=0; i <= numLines*2; i++) {
+        M_grid[1].indices.push_back(i);
+    }
+    M_grid[1].initMesh(this, &VD_line);
+}
+
+// The values of a live source may outgrow the scale computed at the start (e.g. a stream starting with
+// zeros): the bars and the grid are scaled again to the new maximum
+void BarChart::rescale() {
+    if (!csv.isLive()) {
+        return;
+    }
+    int excludeCol[1] = {0};
+    float newMax = csv.getMaxValue(excludeCol, 1);
+    if (newMax <= maxValue) {
+        return;
+    }
+    // by half at least, so that a rising stream is scaled again a few times only
+    maxValue = std::max(newMax, 1.5f * maxValue);
+    scalingFactor = 20/maxValue;
+
+    // the frames in flight still draw the old grid
+    waitDeviceIdle();
+    for (int i = 0; i < 2; i++) {
+        M_grid[i].cleanup();
+        M_grid[i].vertices.clear();
+        M_grid[i].indices.clear();
+    }
+    createGrid();
+    flushUploads();
+    markLayerDirty(GRID_LAYER);
+}
+
+int BarChart::getRow(int line) {
+    return csv.isLive() ? lineRows[(firstLine + line) % csv.getMaxLines()] : line;
+}
+
+// Binding 0 is the mesh shared by the bars, binding 1 the data of each bar
+void BarChart::initBarsVertexDescriptor() {
+    VD_bar.init(this, {
+                {0, sizeof(VertexNormal), VK_VERTEX_INPUT_RATE_VERTEX},
+                {1, sizeof(BarInstance), VK_VERTEX_INPUT_RATE_INSTANCE}
+            }, {
+                {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexNormal, pos), sizeof(glm::vec3), POSITION},
+                {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexNormal, normal), sizeof(glm::vec3), NORMAL},
+                {1, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(BarInstance, pos), sizeof(glm::vec3), OTHER},
+                {1, 3, VK_FORMAT_R32G32B32_SFLOAT, offsetof(BarInstance, colour), sizeof(glm::vec3), OTHER}
+            });
 }
 
 
@@ -3,30 +3,48 @@
 
 #include "BarChart.hpp"
 #include "CSVReader.hpp"
+#include "TileStreamer.hpp"
 
 class BarChartMap : public BarChart {
     public:
 
-        BarChartMap(std::string title, std::string shaderPath, const CSVReader& csv, const CSVReader& csv_coordinates, int latCol, int lonCol, float up, float sx, float dx, float down, const float zoom, std::string mapFile, float dimGrid);
+        BarChartMap(std::string title, std::string shaderPath, DataSource& csv, const CSVReader& csv_coordinates, int latCol, int lonCol, float up, float sx, float dx, float down, const float zoom, std::string mapFile, float dimGrid);
 
     protected:
 
-		struct VertexTexture {
-			glm::vec3 pos;
-			glm::vec3 normal;
-			glm::vec2 UV;
-		};
+        // The map is drawn in tiles (see TileStreamer), each an instance of the unit quad M_ground: every
+        // frame, the tiles in view, finer where the camera is closer, from the layers of T they were copied in
+        struct TileCorner {
+            glm::vec2 corner;
+        };
+
+        struct TileInstance {
+            glm::vec4 rect;         // x and z of the corners of the tile on the ground
+            glm::vec4 uv;           // of the same corners in the layer
+            int layer;
+        };
+
+        static const int MAP_TILES = 128;           // layers of T: about 44 MB with their mip levels
+        static const int MAX_GROUND_TILES = 256;    // drawn in a frame
+        static const int MAX_TILE_UPLOADS = 8;      // copied in T in a frame, when drawn in a window
 
         std::string mapFile;
 
 		// Models, textures and Descriptors (values assigned to the uniforms)
 		// Please note that Model objects depends on the corresponding vertex structure
 		// Models
-		Model<VertexTexture> M_ground;
+		Model<TileCorner> M_ground;
 
 		// Textures
 		Texture T;
 
+        TileStreamer *tiles;
+        std::vector<uint64_t> layerUploads;         // batch copying the tile in each layer of T
+        uint64_t tileFrame;
+        glm::vec4 frustum[6];
+        std::vector<TileInstance> groundTiles;
+        InstanceBuffer I_ground;
+
         struct coordinates * bar_coordinates;
         float zoom;
         float latDim, lonDim;
@@ -35,7 +53,17 @@ class BarChartMap : public BarChart {
 
         void pipelinesAndDescriptorSetsInit() override;
 
-        void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override;
+        void pipelinesAndDescriptorSetsCleanup() override;
+
+        void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, int layer) override;
+
+        void updateGround(uint32_t currentImage, const glm::mat4 &ViewPrj, glm::vec3 camPos) override;
+
+        void selectTiles(const TileStreamer::Tile &tile, glm::vec3 camPos, float pixelsPerUnit);
+
+        void drawTile(const TileStreamer::Tile &tile);
+
+        int tileLayer(const TileStreamer::Tile &tile);
 
 		void localCleanup() override;
 };
@@ -50,7 +78,7 @@ extern "C" {
 }
 
 
-BarChartMap::BarChartMap(std::string title, std::string shaderPath, const CSVReader& csv, const CSVReader& csv_coordinates, int latCol, int lonCol, float up, float sx, float dx, float down, const float zoom, std::string mapFile, float dimGrid = 10000) : BarChart(title, shaderPath, csv, dimGrid){
+BarChartMap::BarChartMap(std::string title, std::string shaderPath, DataSource& csv, const CSVReader& csv_coordinates, int latCol, int lonCol, float up, float sx, float dx, float down, const float zoom, std::string mapFile, float dimGrid = 10000) : BarChart(title, shaderPath, csv, dimGrid){
     up = degreeLatitudeToY(up);
     sx = degreeLongitudeToX(sx);
     dx = degreeLongitudeToX(dx);
@@ -60,13 +88,15 @@ BarChartMap::BarChartMap(std::string title, std::string shaderPath, const CSVRea
     this->lonDim = dx - sx;
     this->zoom = zoom;
     this->mapFile = mapFile;
+    tiles = nullptr;
+    tileFrame = 0;
 
     bar_coordinates = new coordinates[csv_coordinates.getNumLines()];
 
 	for (int i = 0; i < csv_coordinates.getNumLines(); i++) {
 		// Converting latitude and longitude to mercator cartesian coordinates	
-		bar_coordinates[i].x = degreeLatitudeToY(std::stof(csv_coordinates.getLine(i)[latCol]));
-		bar_coordinates[i].z = degreeLongitudeToX(std::stof(csv_coordinates.getLine(i)[lonCol]));
+		bar_coordinates[i].x = degreeLatitudeToY(csv_coordinates.getValue(i, latCol));
+		bar_coordinates[i].z = degreeLongitudeToX(csv_coordinates.getValue(i, lonCol));
 		// Scaling and translating the coordinates
 		bar_coordinates[i].z = -zoom * (bar_coordinates[i].z - sx - (dx - sx) / 2.f);
 		bar_coordinates[i].x = zoom * (up - bar_coordinates[i].x - (up - down) / 2.f);
@@ -79,9 +109,11 @@ BarChartMap::BarChartMap(std::string title, std::string shaderPath, const CSVRea
 // Here you load and setup all your Vulkan Models and Texutures.
 // Here you also create your Descriptor set layouts and load the shaders for the pipelines
 void BarChartMap::localInit() {
-    legend = &Legend::getInstance(window);
+    // the legend has a window of its own
+    legend = headless ? nullptr : &Legend::getInstance(window);
     DSL_bar.init(this, {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
+                {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT}
             });
     DSL_grid.init(this, {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},
@@ -101,13 +133,7 @@ void BarChartMap::localInit() {
                 {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS}
         });
 
-    VD_bar.init(this, {
-                {0, sizeof(VertexColour), VK_VERTEX_INPUT_RATE_VERTEX}
-            }, {
-                {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexColour, pos), sizeof(glm::vec3), POSITION},
-                {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexColour, normal), sizeof(glm::vec3), NORMAL},
-                {0, 2, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexColour, colour), sizeof(glm::vec3), COLOR}
-            });
+    initBarsVertexDescriptor();
     VD_line.init(this, {
                 {0, sizeof(VertexLine), VK_VERTEX_INPUT_RATE_VERTEX}
             }, {
@@ -122,7 +148,8 @@ void BarChartMap::localInit() {
                 // second element : the stride of this binging
                 // third  element : whether this parameter change per vertex or per instance
                 //                  using the corresponding Vulkan constant
-                {0, sizeof(VertexTexture), VK_VERTEX_INPUT_RATE_VERTEX}
+                {0, sizeof(TileCorner), VK_VERTEX_INPUT_RATE_VERTEX},
+                {1, sizeof(TileInstance), VK_VERTEX_INPUT_RATE_INSTANCE}
             }, {
                 // this array contains the location
                 // first  element : the binding number
@@ -144,9 +171,10 @@ void BarChartMap::localInit() {
                 //	in the "sizeof" in the previous array, refers to the correct one,
                 //	if you have more than one vertex format!
                 // ***************************************************
-                {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexTexture, pos), sizeof(glm::vec3), POSITION},
-                {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexTexture, normal), sizeof(glm::vec3), NORMAL},
-                {0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexTexture, UV), sizeof(glm::vec2), UV}
+                {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(TileCorner, corner), sizeof(glm::vec2), OTHER},
+                {1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, rect), sizeof(glm::vec4), OTHER},
+                {1, 2, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(TileInstance, uv), sizeof(glm::vec4), OTHER},
+                {1, 3, VK_FORMAT_R32_SINT, offsetof(TileInstance, layer), sizeof(int), OTHER}
             });
 
     // Pipelines [Shader couples]
@@ -156,7 +184,7 @@ void BarChartMap::localInit() {
     // be used in this pipeline. The first element will be set 0, and so on..
     P_ground.init(this, &VD_ground, shaderDir + "ShaderGround.vert.spv", shaderDir + "ShaderGround.frag.spv", {&DSL_ground, &DSLGubo});
     P_grid.init(this, &VD_line, shaderDir + "ShaderLine.vert.spv", shaderDir + "ShaderLine.frag.spv", {&DSL_grid, &DSLGubo});
-    P_bar.init(this, &VD_bar, shaderDir + "ShaderBar.vert.spv", shaderDir + "ShaderBar.frag.spv", {&DSL_bar, &DSLGubo});
+    P_bar.init(this, &VD_bar, shaderDir + "ShaderBarInstanced.vert.spv", shaderDir + "ShaderBar.frag.spv", {&DSL_bar, &DSLGubo});
 
 
     // Models, textures and Descriptors (values assigned to the uniforms)
@@ -166,109 +194,89 @@ void BarChartMap::localInit() {
     // The third parameter is the file name
     // The last is a constant specifying the file type: currently only OBJ or GLTF
     
-    // Creates a mesh with direct enumeration of vertices and indices
+    // Creates a mesh with direct enumeration of vertices and indices: the corners of a tile, as its UV
     M_ground.vertices = {
-                    {{-groundX,-0.1,-groundZ}, {0.f, 1.f, 0.f}, {1.0f,0.0f}},
-                    {{-groundX,-0.1,groundZ}, {0.f, 1.f, 0.f}, {0.0f,0.0f}},
-                    {{groundX,-0.1,-groundZ}, {0.f, 1.f, 0.f}, {1.0f,1.0f}},
-                    {{groundX,-0.1,groundZ}, {0.f, 1.f, 0.f}, {0.0f,1.0f}}
+                    {{1.0f,0.0f}},
+                    {{0.0f,0.0f}},
+                    {{1.0f,1.0f}},
+                    {{0.0f,1.0f}}
     };
     M_ground.indices = {0, 1, 2, 1, 3, 2};
     M_ground.initMesh(this, &VD_ground);
 
-    // create grid
-    int tmp[1] = {0};
-    int numLines = csv.getMaxValue(tmp, 1) / gridDim + 1;
-    for(int i=0; i <= numLines; i++) {
-        M_grid[0].vertices.push_back({{-groundX, i*gridDim*scalingFactor+minHeight, 0}, {1, 1, 1}});
-        M_grid[0].vertices.push_back({{groundX, i*gridDim*scalingFactor+minHeight, 0}, {1, 1, 1}});
-        printf("%f\n", i*gridDim*scalingFactor);
-    }
-    for(int i=0; i <= numLines*2; i++) {
-        M_grid[0].indices.push_back(i);
-    }
-    M_grid[0].initMesh(this, &VD_line);
-
-    for(int i=0; i <= numLines; i++) {
-        M_grid[1].vertices.push_back({{0, i*gridDim*scalingFactor+minHeight, -groundZ}, {1, 1, 1}});
-        M_grid[1].vertices.push_back({{0, i*gridDim*scalingFactor+minHeight, groundZ}, {1, 1, 1}});
-        printf("%f\n", i*gridDim*scalingFactor);
-    }
-    for(int i=0; i <= numLines*2; i++) {
-        M_grid[1].indices.push_back(i);
-    }
-    M_grid[1].initMesh(this, &VD_line);
+    createGrid();
 
     std::vector<std::string> names;
     std::vector<glm::vec3> colors;
 
-    //create cilinders for bars
+    //place cilinders for bars
     ///------------------------------------------------------
     for (int i = 0; i < csv.getNumVariables()-1; i++) {
         names.push_back(csv.getVariableNames()[i+1]);
-        //create a parallelepiped of a random color
+        //a cilinder of a random color on the coordinates of its region
         float r = (float)rand() / (float)RAND_MAX;
         float g = (float)rand() / (float)RAND_MAX;
         float b = (float)rand() / (float)RAND_MAX;
         colors.push_back(glm::vec3(r, g, b));
+        bars[i] = {{bar_coordinates[i].x, 0.0f, bar_coordinates[i].z}, {r, g, b}};
+    }
 
-        glm::vec3 colour = glm::vec3{r, g, b};
-
-        int nv1 = 100, nv2 = 2;
-        float x, y, z;
-        glm::vec3 normal;
+    // unit cilinder shared by all the bars, each instance moves it and scales its height
+    int nv1 = 100, nv2 = 2;
+    float x, y, z;
+    glm::vec3 normal;
 
-        // Set cylinder position and height parameters
-        glm::vec3 cylinderPosition = glm::vec3(bar_coordinates[i].x, 0.0f, bar_coordinates[i].z);  // Adjust the position
-        float cylinderHeight = 1.0f;  // Adjust the height
-        float cylinderRadius = 0.5f;
+    // Set cylinder height parameters
+    float cylinderHeight = 1.0f;
+    float cylinderRadius = 0.5f;
 
-        for (int j = 0; j < nv1; j++) {
-            for (int k = 0; k < nv2; k++) {
-                x = cylinderRadius * cos(2 * M_PI * j/ (nv1 - 1)) + cylinderPosition.x;
-                y = cylinderPosition.y + cylinderHeight * k / (nv2 - 1);
-                z = cylinderRadius * sin(2 * M_PI * j/ (nv1 - 1)) + cylinderPosition.z;
+    for (int j = 0; j < nv1; j++) {
+        for (int k = 0; k < nv2; k++) {
+            x = cylinderRadius * cos(2 * M_PI * j/ (nv1 - 1));
+            y = cylinderHeight * k / (nv2 - 1);
+            z = cylinderRadius * sin(2 * M_PI * j/ (nv1 - 1));
 
-                // compute the normal vector
-                normal = glm::normalize(glm::vec3{x - cylinderPosition.x, 0, z - cylinderPosition.z});
+            // compute the normal vector
+            normal = glm::normalize(glm::vec3{x, 0, z});
 
-                // add the position and the normal vector of the vertex to the array M_bars[i].vertices
-                M_bars[i].vertices.push_back({{x, y, z}, normal, colour});  // vertex j*nv+k - Position and Normal
-            }
+            // add the position and the normal vector of the vertex to the array M_bar.vertices
+            M_bar.vertices.push_back({{x, y, z}, normal});  // vertex j*nv+k - Position and Normal
         }
+    }
 
-        // push the center of the top and bottom faces
-        M_bars[i].vertices.push_back({{cylinderPosition.x, cylinderPosition.y, cylinderPosition.z}, glm::vec3{0, -1, 0}, colour});
-        M_bars[i].vertices.push_back({{cylinderPosition.x, cylinderPosition.y + cylinderHeight, cylinderPosition.z}, glm::vec3{0, 1, 0}, colour});
+    // push the center of the top and bottom faces
+    M_bar.vertices.push_back({{0, 0, 0}, glm::vec3{0, -1, 0}});
+    M_bar.vertices.push_back({{0, cylinderHeight, 0}, glm::vec3{0, 1, 0}});
 
-        // push the other vertices of the top and bottom faces
-        for (int j = 0; j < nv1; j++) {
-            x = cylinderRadius * cos(2 * M_PI * j / (nv1 - 1)) + cylinderPosition.x;
-            z = cylinderRadius * sin(2 * M_PI * j / (nv1 - 1)) + cylinderPosition.z;
+    // push the other vertices of the top and bottom faces
+    for (int j = 0; j < nv1; j++) {
+        x = cylinderRadius * cos(2 * M_PI * j / (nv1 - 1));
+        z = cylinderRadius * sin(2 * M_PI * j / (nv1 - 1));
 
-            // add the position and the normal vector of the vertex to the array M_bars[i].vertices
-            M_bars[i].vertices.push_back({{x, cylinderPosition.y, z}, glm::vec3{0, -1, 0}, colour});
-            M_bars[i].vertices.push_back({{x, cylinderPosition.y + cylinderHeight, z}, glm::vec3{0, 1, 0}, colour});
-        }
-        
-        // Fill the array M_bars[i].indices with the indices of the vertices of the triangles
-        for (int j = 0; j < nv1 - 1; j++) {
-            for (int k = 0; k < nv2 - 1; k++) {
-                M_bars[i].indices.push_back(j * nv2 + k); M_bars[i].indices.push_back(j * nv2 + k + 1); M_bars[i].indices.push_back((j + 1) * nv2 + k);
-                M_bars[i].indices.push_back(j * nv2 + k + 1); M_bars[i].indices.push_back((j + 1) * nv2 + k + 1); M_bars[i].indices.push_back((j + 1) * nv2 + k);
-            }
-        }
+        // add the position and the normal vector of the vertex to the array M_bar.vertices
+        M_bar.vertices.push_back({{x, 0, z}, glm::vec3{0, -1, 0}});
+        M_bar.vertices.push_back({{x, cylinderHeight, z}, glm::vec3{0, 1, 0}});
+    }
 
-        // push the triengles of the top and bottom circles
-        for (int j = 0; j < nv1 - 1; j++) {
-            M_bars[i].indices.push_back(nv1 * nv2); M_bars[i].indices.push_back(nv1 * nv2 + 2 * j + 2); M_bars[i].indices.push_back(nv1 * nv2 + 2 * j + 4);
-            M_bars[i].indices.push_back(nv1 * nv2 + 1); M_bars[i].indices.push_back(nv1 * nv2 + 2 * j + 3); M_bars[i].indices.push_back(nv1 * nv2 + 2 * j + 5);
+    // Fill the array M_bar.indices with the indices of the vertices of the triangles
+    for (int j = 0; j < nv1 - 1; j++) {
+        for (int k = 0; k < nv2 - 1; k++) {
+            M_bar.indices.push_back(j * nv2 + k); M_bar.indices.push_back(j * nv2 + k + 1); M_bar.indices.push_back((j + 1) * nv2 + k);
+            M_bar.indices.push_back(j * nv2 + k + 1); M_bar.indices.push_back((j + 1) * nv2 + k + 1); M_bar.indices.push_back((j + 1) * nv2 + k);
         }
-        M_bars[i].indices.push_back(nv1 * nv2); M_bars[i].indices.push_back(nv1 * nv2 + 2 * nv1); M_bars[i].indices.push_back(nv1 * nv2 + 2);
-        M_bars[i].indices.push_back(nv1 * nv2 + 1); M_bars[i].indices.push_back(nv1 * nv2 + 2 * nv1 + 1); M_bars[i].indices.push_back(nv1 * nv2 + 3);
+    }
+
+    // push the triengles of the top and bottom circles
+    for (int j = 0; j < nv1 - 1; j++) {
+        M_bar.indices.push_back(nv1 * nv2); M_bar.indices.push_back(nv1 * nv2 + 2 * j + 2); M_bar.indices.push_back(nv1 * nv2 + 2 * j + 4);
+        M_bar.indices.push_back(nv1 * nv2 + 1); M_bar.indices.push_back(nv1 * nv2 + 2 * j + 3); M_bar.indices.push_back(nv1 * nv2 + 2 * j + 5);
+    }
+    M_bar.indices.push_back(nv1 * nv2); M_bar.indices.push_back(nv1 * nv2 + 2 * nv1); M_bar.indices.push_back(nv1 * nv2 + 2);
+    M_bar.indices.push_back(nv1 * nv2 + 1); M_bar.indices.push_back(nv1 * nv2 + 2 * nv1 + 1); M_bar.indices.push_back(nv1 * nv2 + 3);
 
-        M_bars[i].initMesh(this, &VD_bar);
-        _BP_Ref = this;
+    M_bar.initMesh(this, &VD_bar);
+    _BP_Ref = this;
+    if (!headless) {
         glfwSetMouseButtonCallback(window, mouseButtonCallback);
     }
 //----------------------------------------------------------
@@ -276,9 +284,16 @@ void BarChartMap::localInit() {
     
     // Create the textures
     // The second parameter is the file name
-    T.init(this,   mapFile.c_str());
-	txt.init(this, &demoText);
+    // the tiles of the map: empty layers, filled as the tiles are read
+    // a layer is copied again only once the frames in flight do not draw it anymore
+    tiles = new TileStreamer(mapFile, MAP_TILES, MAX_FRAMES_IN_FLIGHT);
+    layerUploads.assign(MAP_TILES, 0);
+    T.initArray(this, TileStreamer::TILE_SIZE, TileStreamer::TILE_SIZE, MAP_TILES, VK_FORMAT_R8G8B8A8_SRGB);
+    groundTiles.reserve(MAX_GROUND_TILES);
+	txt.init(this, &demoText, sizeof(timeLabel));
+	timeText = txt.addDynamicText(sizeof(timeLabel));
 	hud.init(this);
+	initLabels(names, {0.0f, 0.0f, 0.0f});
     
     // Init local variables
     CamH = 0.0f;
@@ -287,8 +302,8 @@ void BarChartMap::localInit() {
     CamPitch = 0.53f;
     CamYaw = 2.7f;
 
-    visualizedValues = (float *)malloc((csv.getNumVariables()-1)*sizeof(float));
-    legend->setLegend(names, colors);
+    initValues();
+    initLegend(names, colors);
 }
 
 // Here you create your pipelines and Descriptor Sets!
@@ -312,11 +327,19 @@ void BarChartMap::pipelinesAndDescriptorSetsInit() {
         });
     
 
+    // the tiles change every frame: the command buffers always draw all of them, the unused ones flat
+    I_ground.init(this, MAX_GROUND_TILES * sizeof(TileInstance));
+
     P_bar.create();
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        DS_bars[i].init(this, &DSL_bar, {
-                {0, UNIFORM, sizeof(UniformBlock), nullptr}
-            });
+    for (size_t c = 0; c < DS_bars.size(); c++) {
+        DS_bars[c].init(this, &DSL_bar, {
+                    {0, UNIFORM, sizeof(BarsUniformBlock), nullptr},
+                    {1, STORAGE, 0, nullptr, &SB_values[c]}
+                });
+    }
+    I_bars.init(this, bars.size() * sizeof(BarInstance));
+    for (size_t i = 0; i < swapChainImages.size(); i++) {
+        I_bars.map(i, bars.data(), bars.size() * sizeof(BarInstance));
     }
 
     P_grid.create(VK_PRIMITIVE_TOPOLOGY_LINE_LIST, gridLinesWidth);
@@ -329,57 +352,174 @@ void BarChartMap::pipelinesAndDescriptorSetsInit() {
 
     txt.pipelinesAndDescriptorSetsInit();
     hud.pipelinesAndDescriptorSetsInit();
+    labels.pipelinesAndDescriptorSetsInit();
+}
+
+void BarChartMap::pipelinesAndDescriptorSetsCleanup() {
+    BarChart::pipelinesAndDescriptorSetsCleanup();
+    I_ground.cleanup();
 }
 
 /// NOTE: need this because parent will try to use parent M_ground
-void BarChartMap::populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
-    // binds the pipeline
-    P_ground.bind(commandBuffer);
-    DSGubo.bind(commandBuffer, P_ground, 1, currentImage);
-    // For a pipeline object, this command binds the corresponing pipeline to the command buffer passed in its parameter
-
-    // binds the data set
-    DS_ground.bind(commandBuffer, P_ground, 0, currentImage);
-    // For a Dataset object, this command binds the corresponing dataset
-    // to the command buffer and pipeline passed in its first and second parameters.
-    // The third parameter is the number of the set being bound
-    // As described in the Vulkan tutorial, a different dataset is required for each image in the swap chain.
-    // This is done automatically in file Starter.hpp, however the command here needs also the index
-    // of the current image in the swap chain, passed in its last parameter
-    
-    // binds the model
-    M_ground.bind(commandBuffer);
-    // For a Model object, this command binds the corresponing index and vertex buffer
-    // to the command buffer passed in its parameter
+void BarChartMap::populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, int layer) {
+    switch (layer) {
+    case GROUND_LAYER:
+        // binds the pipeline
+        P_ground.bind(commandBuffer);
+        DSGubo.bind(commandBuffer, P_ground, 1, currentImage);
+        // For a pipeline object, this command binds the corresponing pipeline to the command buffer passed in its parameter
+
+        // binds the data set
+        DS_ground.bind(commandBuffer, P_ground, 0, currentImage);
+        // For a Dataset object, this command binds the corresponing dataset
+        // to the command buffer and pipeline passed in its first and second parameters.
+        // The third parameter is the number of the set being bound
+        // As described in the Vulkan tutorial, a different dataset is required for each image in the swap chain.
+        // This is done automatically in file Starter.hpp, however the command here needs also the index
+        // of the current image in the swap chain, passed in its last parameter
+        
+        // binds the model
+        M_ground.bind(commandBuffer);
+        // For a Model object, this command binds the corresponing index and vertex buffer
+        // to the command buffer passed in its parameter
+        I_ground.bind(commandBuffer, 1, currentImage);
+
+        // record the drawing command in the command buffer
+        drawIndexed(commandBuffer, static_cast<uint32_t>(M_ground.indices.size()), MAX_GROUND_TILES);
+        // the second parameter is the number of indexes to be drawn. For a Model object,
+        // this can be retrieved with the .indices.size() method.
+        break;
+
+    case BARS_LAYER:
+        // all the bars at once: one instance of M_bar each
+        P_bar.bind(commandBuffer);
+        DSGubo.bind(commandBuffer, P_bar, 1, currentImage);
+        DS_bars[valuesChunk].bind(commandBuffer, P_bar, 0, currentImage);
+        M_bar.bind(commandBuffer);
+        I_bars.bind(commandBuffer, 1, currentImage);
+        drawIndexed(commandBuffer,
+                static_cast<uint32_t>(M_bar.indices.size()), static_cast<uint32_t>(bars.size()));
+        // the name of each region, over its bar
+        labels.populateCommandBuffer(commandBuffer, currentImage, DS_bars[valuesChunk]);
+        break;
+
+    case GRID_LAYER:
+        P_grid.bind(commandBuffer);
+        DSGubo.bind(commandBuffer, P_grid, 1, currentImage);
+        DS_grid[0].bind(commandBuffer, P_grid, 0, currentImage);
+        M_grid[0].bind(commandBuffer);
+        drawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[0].indices.size()));
+
+        DS_grid[1].bind(commandBuffer, P_grid, 0, currentImage);
+        M_grid[1].bind(commandBuffer);
+        drawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[1].indices.size()));
+        break;
+
+    case OVERLAY_LAYER:
+        txt.populateCommandBuffer(commandBuffer, currentImage, 0);
+        txt.populateDynamicCommandBuffer(commandBuffer, currentImage);
+        hud.populateCommandBuffer(commandBuffer, currentImage, 0);
+        break;
+    }
+}
 
-    // record the drawing command in the command buffer
-    vkCmdDrawIndexed(commandBuffer,
-            static_cast<uint32_t>(M_ground.indices.size()), 1, 0, 0, 0);
-    // the second parameter is the number of indexes to be drawn. For a Model object,
-    // this can be retrieved with the .indices.size() method.
+// The tiles of the map covering the ground in view: the coarsest ones that give about a pixel of a tile per
+// pixel of the window, or the nearest of their ancestors already loaded. The tiles read since the last frame
+// are copied in their layers first, on the transfer queue: they are drawn from the frame where the copy is
+// complete.
+void BarChartMap::updateGround(uint32_t currentImage, const glm::mat4 &ViewPrj, glm::vec3 camPos) {
+    tileFrame++;
+    // the whole map stays loaded, shown wherever nothing finer is
+    tiles->use({0, 0, 0}, tileFrame);
+    // planes of the view frustum, inside where dot(plane, (p, 1)) >= 0
+    glm::mat4 M = glm::transpose(ViewPrj);
+    frustum[0] = M[3] + M[0];
+    frustum[1] = M[3] - M[0];
+    frustum[2] = M[3] + M[1];
+    frustum[3] = M[3] - M[1];
+    frustum[4] = M[3] + M[2];
+    frustum[5] = M[3] - M[2];
+    // pixels covered by a length of 1 at a distance of 1 from the camera
+    float pixelsPerUnit = height / (2.0f * tan(FOVy / 2.0f));
+
+    // a snapshot or an export waits for the tiles it shows, a window draws their ancestors meanwhile
+    if (headless) {
+        groundTiles.clear();
+        selectTiles({0, 0, 0}, camPos, pixelsPerUnit);
+        tiles->waitLoaded();
+    }
+    TileStreamer::LoadedTile loaded[MAP_TILES];
+    int numLoaded = tiles->takeLoaded(loaded, headless ? MAP_TILES : MAX_TILE_UPLOADS);
+    for (int i = 0; i < numLoaded; i++) {
+        layerUploads[loaded[i].slot] = uploadImageAsync(loaded[i].pixels, T.textureImage,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, TileStreamer::TILE_SIZE, TileStreamer::TILE_SIZE,
+                T.mipLevels, loaded[i].slot);
+        TileStreamer::freePixels(loaded[i].pixels);
+    }
+    if (headless && numLoaded > 0) {
+        finishAsyncUploads();
+    }
 
+    groundTiles.clear();
+    selectTiles({0, 0, 0}, camPos, pixelsPerUnit);
+    groundTiles.resize(MAX_GROUND_TILES, TileInstance{glm::vec4(0.0f), glm::vec4(0.0f), 0});
+    I_ground.map(currentImage, groundTiles.data(), MAX_GROUND_TILES * sizeof(TileInstance));
+}
 
-    P_bar.bind(commandBuffer);
-    DSGubo.bind(commandBuffer, P_bar, 1, currentImage);
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        DS_bars[i].bind(commandBuffer, P_bar, 0, currentImage);
-        M_bars[i].bind(commandBuffer);
-        vkCmdDrawIndexed(commandBuffer,
-                static_cast<uint32_t>(M_bars[i].indices.size()), 1, 0, 0, 0);
-    }   
-
-    P_grid.bind(commandBuffer);
-    DSGubo.bind(commandBuffer, P_grid, 1, currentImage);
-    DS_grid[0].bind(commandBuffer, P_grid, 0, currentImage);
-    M_grid[0].bind(commandBuffer);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[0].indices.size()), 1, 0, 0, 0);
-
-    DS_grid[1].bind(commandBuffer, P_grid, 0, currentImage);
-    M_grid[1].bind(commandBuffer);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(M_grid[1].indices.size()), 1, 0, 0, 0);
-
-    txt.populateCommandBuffer(commandBuffer, currentImage, 0);
-    hud.populateCommandBuffer(commandBuffer, currentImage, 0);
+void BarChartMap::selectTiles(const TileStreamer::Tile &tile, glm::vec3 camPos, float pixelsPerUnit) {
+    // the tile covers [x / n, (x + 1) / n] x [y / n, (y + 1) / n] of the map, u along -z and v along x
+    float n = (float)(1 << tile.level);
+    glm::vec3 low(groundX * (2.0f * tile.y / n - 1.0f), -0.1f, groundZ * (1.0f - 2.0f * (tile.x + 1) / n));
+    glm::vec3 high(groundX * (2.0f * (tile.y + 1) / n - 1.0f), -0.1f, groundZ * (1.0f - 2.0f * tile.x / n));
+    for (int i = 0; i < 6; i++) {
+        glm::vec3 farthest(frustum[i].x >= 0 ? high.x : low.x, -0.1f, frustum[i].z >= 0 ? high.z : low.z);
+        if (glm::dot(glm::vec3(frustum[i]), farthest) + frustum[i].w < 0) {
+            return;
+        }
+    }
+
+    float distance = std::max(glm::distance(camPos, glm::clamp(camPos, low, high)), nearPlane);
+    float pixels = std::max(high.x - low.x, high.z - low.z) * pixelsPerUnit / distance;
+    if (pixels > TileStreamer::TILE_SIZE && tile.level < tiles->getMaxLevel()) {
+        for (int i = 0; i < 4; i++) {
+            selectTiles({tile.level + 1, 2 * tile.x + i % 2, 2 * tile.y + i / 2}, camPos, pixelsPerUnit);
+        }
+        return;
+    }
+    drawTile(tile);
+}
+
+void BarChartMap::drawTile(const TileStreamer::Tile &tile) {
+    if (groundTiles.size() == MAX_GROUND_TILES) {
+        return;
+    }
+    // the tile, or the part of its nearest loaded ancestor it covers
+    TileStreamer::Tile t = tile;
+    glm::vec4 uv(0.0f, 0.0f, 1.0f, 1.0f);
+    int layer = tileLayer(t);
+    while (layer < 0 && t.level > 0) {
+        glm::vec2 half(t.x % 2, t.y % 2);
+        uv = glm::vec4((glm::vec2(uv.x, uv.y) + half) / 2.0f, (glm::vec2(uv.z, uv.w) + half) / 2.0f);
+        t = {t.level - 1, t.x / 2, t.y / 2};
+        layer = tileLayer(t);
+    }
+    if (layer < 0) {
+        return;
+    }
+
+    float n = (float)(1 << tile.level);
+    glm::vec4 rect(groundX * (2.0f * tile.y / n - 1.0f), groundZ * (1.0f - 2.0f * tile.x / n),
+                   groundX * (2.0f * (tile.y + 1) / n - 1.0f), groundZ * (1.0f - 2.0f * (tile.x + 1) / n));
+    groundTiles.push_back({rect, uv, layer});
+}
+
+// The layer of T holding the tile, or -1 if it is not there yet, or still being copied
+int BarChartMap::tileLayer(const TileStreamer::Tile &tile) {
+    int layer = tiles->use(tile, tileFrame);
+    if (layer >= 0 && !isUploadComplete(layerUploads[layer])) {
+        return -1;
+    }
+    return layer;
 }
 
 // Here you destroy all the Models, Texture and Desc. Set Layouts you created!
@@ -390,10 +530,13 @@ void BarChartMap::localCleanup() {
     /// NOTE: can't call parent's cleanup because it will try to use parent's M_ground
     // Cleanup textures
     T.cleanup();
+    delete tiles;
+    tiles = nullptr;
     // Cleanup models
     M_ground.cleanup();
-    for (int i = 0; i < csv.getNumVariables()-1; i++) {
-        M_bars[i].cleanup();
+    M_bar.cleanup();
+    for (StorageBuffer &SB : SB_values) {
+        SB.cleanup();
     }
     M_grid[0].cleanup();
     M_grid[1].cleanup();
@@ -409,6 +552,7 @@ void BarChartMap::localCleanup() {
     P_bar.destroy();
     P_grid.destroy();
 
+	labels.localCleanup();
 	txt.localCleanup();
 	hud.localCleanup();
 }
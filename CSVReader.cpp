@@ -1,77 +1,487 @@
 #include "CSVReader.hpp"
+#include "FileInfo.hpp"
 
 #include <fstream>
-#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <thread>
+#include <algorithm>
+#include <limits>
 
-CSVReader::CSVReader(std::string filename, char delimiter) {
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Whole file mapped read-only in memory (or read in a buffer where mmap is not available)
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    std::string buffer;
+#endif
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // sequential: the file will be read once from start to end
+    MappedFile(const std::string &filename, bool sequential = false) {
+#ifndef _WIN32
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+                data = (const char *)p;
+                size = st.st_size;
+            }
+        }
+        close(fd);
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + filename);
+        }
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data) {
+            munmap((void *)data, size);
+        }
+#endif
+    }
+};
+
+// Binary snapshot layout: SnapshotHeader, ColumnStats[numVariables], padding up to valuesOffset,
+// float[numVariables * numLines] (column after column), then the variable names followed by the
+// labels, each stored as a uint32_t length and its characters.
+const char SNAPSHOT_MAGIC[8] = {'C', 'S', 'V', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+const size_t SNAPSHOT_ALIGNMENT = 64;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint32_t numVariables;
+    uint32_t numLines;
+    uint64_t valuesOffset;
+    uint64_t textOffset;
+    char delimiter;
+};
+
+// Files smaller than this are parsed by a single thread
+const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+const char *lineEnd(const char *p, const char *end) {
+    if (p >= end) return end;
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+int countLines(const char *p, const char *end) {
+    int n = 0;
+    while (p < end) {
+        p = lineEnd(p, end) + 1;
+        n++;
+    }
+    return n;
+}
+
+float parseFloat(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p < end && *p == '+') p++;
+    float value;
+#if defined(__cpp_lib_to_chars)
+    if (std::from_chars(p, end, value).ec == std::errc()) {
+        return value;
+    }
+    return NAN;
+#else
+    // strtof needs a terminated string
+    char buf[64];
+    size_t len = std::min((size_t)(end - p), sizeof(buf) - 1);
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    char *stop;
+    value = std::strtof(buf, &stop);
+    return stop != buf ? value : NAN;
+#endif
+}
+
+// min/max/sum/count of the numbers in v, NaN cells are skipped
+CSVReader::ColumnStats reduceColumn(const float *v, int n) {
+    float minValue = std::numeric_limits<float>::infinity();
+    float maxValue = -std::numeric_limits<float>::infinity();
+    double sum = 0.0;
+    int count = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 vmin = _mm_set1_ps(minValue), vmax = _mm_set1_ps(maxValue);
+    __m128d vsumLo = _mm_setzero_pd(), vsumHi = _mm_setzero_pd();
+    __m128i vcount = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(v + i);
+        __m128 isNumber = _mm_cmpord_ps(x, x);
+        // min/max return the second operand when the first is NaN
+        vmin = _mm_min_ps(x, vmin);
+        vmax = _mm_max_ps(x, vmax);
+        x = _mm_and_ps(x, isNumber);
+        vsumLo = _mm_add_pd(vsumLo, _mm_cvtps_pd(x));
+        vsumHi = _mm_add_pd(vsumHi, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+        vcount = _mm_sub_epi32(vcount, _mm_castps_si128(isNumber)); // true lanes are -1
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vmin);
+    minValue = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, vmax);
+    maxValue = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    double sums[2];
+    _mm_storeu_pd(sums, _mm_add_pd(vsumLo, vsumHi));
+    sum = sums[0] + sums[1];
+    int counts[4];
+    _mm_storeu_si128((__m128i *)counts, vcount);
+    count = counts[0] + counts[1] + counts[2] + counts[3];
+#endif
+    for (; i < n; i++) {
+        if (!std::isnan(v[i])) {
+            minValue = std::min(minValue, v[i]);
+            maxValue = std::max(maxValue, v[i]);
+            sum += v[i];
+            count++;
+        }
+    }
+    return {minValue, maxValue, sum, count};
+}
+
+}
+
+CSVReader::CSVReader(std::string filename, char delimiter, bool useSnapshot) {
     this->filename = filename;
     this->delimiter = delimiter;
-    readHeader();
-    readData();
+    std::string snapshotName = filename + ".bin";
+    if (useSnapshot && readSnapshot(snapshotName)) {
+        return;
+    }
+    {
+        MappedFile file(filename, true);
+        const char *end = file.data + file.size;
+        const char *body = readHeader(file.data, end);
+        readData(body, end);
+    }
+    if (useSnapshot) {
+        writeSnapshot(snapshotName);
+    }
 }
 
 int CSVReader::getNumVariables() const {
     return numVariables;
 }
 
-std::vector<std::string> CSVReader::getVariableNames() const {
+const std::vector<std::string> &CSVReader::getVariableNames() const {
     return variableNames;
 }
 
-std::vector<std::string> CSVReader::getLine(int lineNumber) const {
-    return data[lineNumber];
+const std::string &CSVReader::getLabel(int lineNumber) const {
+    return labels[lineNumber];
+}
+
+CSVReader::Column CSVReader::getColumn(int columnNumber) const {
+    return {values + (size_t)columnNumber * numLines, numLines};
+}
+
+float CSVReader::getValue(int lineNumber, int columnNumber) const {
+    return values[(size_t)columnNumber * numLines + lineNumber];
 }
 
 int CSVReader::getNumLines() const {
-    return data.size();
+    return numLines;
 }
 
-void CSVReader::readHeader() {
-    std::ifstream file(filename);
-    std::string line;
-    std::getline(file, line);
-    std::stringstream ss(line);
-    std::string token;
-    while (std::getline(ss, token, delimiter)) {
-        variableNames.push_back(token);
-    }
+// Returns where the data lines start
+const char *CSVReader::readHeader(const char *begin, const char *end) {
+    const char *eol = lineEnd(begin, end);
+    variableNames = splitLine(begin, eol, delimiter);
     numVariables = variableNames.size();
+    return eol < end ? eol + 1 : end;
+}
+
+// The data is split in newline-aligned chunks parsed in parallel: lines are counted first
+// so that every thread can write its values straight into the final columns.
+void CSVReader::readData(const char *begin, const char *end) {
+    size_t size = end - begin;
+    int numChunks = std::max(1u, std::thread::hardware_concurrency());
+    numChunks = std::max(1, std::min(numChunks, (int)(size / MIN_CHUNK_SIZE)));
+
+    std::vector<const char *> bounds(numChunks + 1);
+    bounds[0] = begin;
+    for (int c = 1; c < numChunks; c++) {
+        const char *p = std::max(begin + size * c / numChunks, bounds[c-1]);
+        bounds[c] = p < end ? std::min(lineEnd(p, end) + 1, end) : end;
+    }
+    bounds[numChunks] = end;
+
+    std::vector<int> firstLine(numChunks + 1, 0);
+    std::vector<std::thread> workers;
+    for (int c = 1; c < numChunks; c++) {
+        workers.emplace_back([&, c] { firstLine[c+1] = countLines(bounds[c], bounds[c+1]); });
+    }
+    firstLine[1] = countLines(bounds[0], bounds[1]);
+    for (auto &w : workers) w.join();
+    workers.clear();
+    for (int c = 1; c <= numChunks; c++) {
+        firstLine[c] += firstLine[c-1];
+    }
+
+    numLines = firstLine[numChunks];
+    labels.resize(numLines);
+    auto columns = std::make_shared<std::vector<float>>((size_t)numVariables * numLines);
+    values = columns->data();
+    storage = columns;
+
+    for (int c = 1; c < numChunks; c++) {
+        workers.emplace_back(&CSVReader::parseLines, this, bounds[c], bounds[c+1], firstLine[c], columns->data());
+    }
+    parseLines(bounds[0], bounds[1], firstLine[0], columns->data());
+    for (auto &w : workers) w.join();
+
+    computeStats();
+}
+
+void CSVReader::parseLines(const char *begin, const char *end, int firstLine, float *columns) {
+    int i = firstLine;
+    const char *p = begin;
+    while (p < end) {
+        const char *eol = lineEnd(p, end);
+        parseLine(p, eol, delimiter, numVariables, columns + i, numLines, labels[i]);
+        p = eol + 1;
+        i++;
+    }
+}
+
+std::vector<std::string> CSVReader::splitLine(const char *begin, const char *end, char delimiter) {
+    std::vector<std::string> cells;
+    const char *last = (end > begin && end[-1] == '\r') ? end - 1 : end;
+    const char *p = begin;
+    while (p < last) {
+        const char *d = (const char *)memchr(p, delimiter, last - p);
+        if (!d) d = last;
+        cells.emplace_back(p, d);
+        p = d + 1;
+    }
+    return cells;
+}
+
+void CSVReader::parseLine(const char *begin, const char *end, char delimiter, int numVariables, float *values, size_t stride, std::string &label) {
+    const char *last = (end > begin && end[-1] == '\r') ? end - 1 : end;
+    const char *p = begin;
+    int j = 0;
+    while (j < numVariables && p < last) {
+        const char *d = (const char *)memchr(p, delimiter, last - p);
+        if (!d) d = last;
+        if (j == 0) {
+            label.assign(p, d);
+        }
+        values[j * stride] = parseFloat(p, d);
+        p = d + 1;
+        j++;
+    }
+    // missing trailing cells are not numbers
+    for (; j < numVariables; j++) {
+        values[j * stride] = NAN;
+    }
+}
+
+void CSVReader::computeStats() {
+    stats.resize(numVariables);
+    computeStats(values, numLines, numVariables, stats.data());
+}
+
+void CSVReader::computeStats(const float *values, int numLines, int numVariables, ColumnStats *stats) {
+    int numWorkers = std::max(1, std::min((int)std::thread::hardware_concurrency(), numVariables));
+    auto reduce = [=](int first) {
+        for (int j = first; j < numVariables; j += numWorkers) {
+            stats[j] = reduceColumn(values + (size_t)j * numLines, numLines);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int w = 1; w < numWorkers; w++) {
+        workers.emplace_back(reduce, w);
+    }
+    reduce(0);
+    for (auto &w : workers) w.join();
+}
+
+// Maps the snapshot and uses its values in place. Returns false, leaving the reader untouched,
+// if the snapshot is missing, unreadable or older than the CSV file.
+bool CSVReader::readSnapshot(const std::string &snapshotName) {
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!fileInfo(filename, sourceSize, sourceMtime)) {
+        return false;
+    }
+
+    std::shared_ptr<MappedFile> file;
+    try {
+        file = std::make_shared<MappedFile>(snapshotName);
+    } catch (const std::exception &) {
+        return false;
+    }
+    SnapshotHeader header;
+    if (file->size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, file->data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.byteOrder != SNAPSHOT_BYTE_ORDER ||
+        header.sourceSize != sourceSize || header.sourceMtime != sourceMtime ||
+        header.delimiter != delimiter) {
+        return false;
+    }
+    uint64_t valuesSize = (uint64_t)header.numVariables * header.numLines * sizeof(float);
+    if (header.valuesOffset < sizeof(header) + header.numVariables * sizeof(ColumnStats) ||
+        header.valuesOffset % SNAPSHOT_ALIGNMENT != 0 ||
+        header.textOffset < header.valuesOffset + valuesSize || header.textOffset > file->size) {
+        return false;
+    }
+
+    std::vector<std::string> text;
+    const char *p = file->data + header.textOffset;
+    const char *end = file->data + file->size;
+    for (uint64_t k = 0; k < (uint64_t)header.numVariables + header.numLines; k++) {
+        uint32_t len;
+        if (end - p < (ptrdiff_t)sizeof(len)) {
+            return false;
+        }
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        if ((uint64_t)(end - p) < len) {
+            return false;
+        }
+        text.emplace_back(p, p + len);
+        p += len;
+    }
+
+    numVariables = header.numVariables;
+    numLines = header.numLines;
+    variableNames.assign(text.begin(), text.begin() + numVariables);
+    labels.assign(text.begin() + numVariables, text.end());
+    stats.resize(numVariables);
+    memcpy(stats.data(), file->data + sizeof(header), numVariables * sizeof(ColumnStats));
+    values = (const float *)(file->data + header.valuesOffset);
+    storage = file;
+    return true;
 }
 
-void CSVReader::readData() {
-    std::ifstream file(filename);
-    std::string line;
-    std::getline(file, line); // skip header
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string token;
-        std::vector<std::string> lineData;
-        while (std::getline(ss, token, delimiter)) {
-            lineData.push_back(token);
+// Best effort: a snapshot that can not be written (e.g. read-only directory) only means parsing next time too.
+// The file is written under a temporary name and renamed, so a reader never sees it half written.
+void CSVReader::writeSnapshot(const std::string &snapshotName) const {
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    if (!fileInfo(filename, header.sourceSize, header.sourceMtime)) {
+        return;
+    }
+    header.numVariables = numVariables;
+    header.numLines = numLines;
+    header.delimiter = delimiter;
+    uint64_t statsEnd = sizeof(header) + numVariables * sizeof(ColumnStats);
+    header.valuesOffset = (statsEnd + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    header.textOffset = header.valuesOffset + (uint64_t)numVariables * numLines * sizeof(float);
+
+    std::string tmpName = snapshotName + ".tmp";
+    FILE *out = fopen(tmpName.c_str(), "wb");
+    if (!out) {
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(stats.data(), sizeof(ColumnStats), numVariables, out) == (size_t)numVariables;
+    std::vector<char> padding(header.valuesOffset - statsEnd, 0);
+    ok = ok && fwrite(padding.data(), 1, padding.size(), out) == padding.size();
+    size_t numValues = (size_t)numVariables * numLines;
+    ok = ok && fwrite(values, sizeof(float), numValues, out) == numValues;
+    for (int pass = 0; pass < 2 && ok; pass++) {
+        for (const std::string &str : (pass == 0 ? variableNames : labels)) {
+            uint32_t len = str.size();
+            ok = ok && fwrite(&len, sizeof(len), 1, out) == 1;
+            ok = ok && fwrite(str.data(), 1, len, out) == len;
         }
-        data.push_back(lineData);
     }
+    ok = (fclose(out) == 0) && ok;
+    if (ok) {
+        std::remove(snapshotName.c_str());
+        ok = std::rename(tmpName.c_str(), snapshotName.c_str()) == 0;
+    }
+    if (!ok) {
+        std::remove(tmpName.c_str());
+    }
+}
+
+const CSVReader::ColumnStats &CSVReader::getColumnStats(int columnNumber) const {
+    return stats[columnNumber];
+}
+
+std::vector<bool> CSVReader::includedColumns(int *excludeColumns, int numExcludeColumns) const {
+    std::vector<bool> included(numVariables, true);
+    for (int k = 0; k < numExcludeColumns; k++) {
+        if (excludeColumns[k] >= 0 && excludeColumns[k] < numVariables) {
+            included[excludeColumns[k]] = false;
+        }
+    }
+    return included;
 }
 
 float CSVReader::getMaxValue(int *excludeColumns, int numExcludeColumns) const {
+    std::vector<bool> included = includedColumns(excludeColumns, numExcludeColumns);
     float maxValue = 0.0;
-    for (int i = 0; i < data.size(); i++) {
-        for (int j = 0; j < data[i].size(); j++) {
-            bool exclude = false;
-            for (int k = 0; k < numExcludeColumns; k++) {
-                if (j == excludeColumns[k]) {
-                    exclude = true;
-                    break;
-                }
-            }
-            if (exclude) {
-                continue;
-            }
-            float value = std::stof(data[i][j]);
-            if (value > maxValue) {
-                maxValue = value;
-            }
+    for (int j = 0; j < numVariables; j++) {
+        if (included[j] && stats[j].max > maxValue) {
+            maxValue = stats[j].max;
         }
     }
     return maxValue;
 }
+
+// Percentile (0-100) of the column maxima: a scale that is not dominated by a single outlier column
+float CSVReader::getMaxValuePercentile(float percentile, int *excludeColumns, int numExcludeColumns) const {
+    std::vector<bool> included = includedColumns(excludeColumns, numExcludeColumns);
+    std::vector<float> maxima;
+    for (int j = 0; j < numVariables; j++) {
+        if (included[j] && stats[j].count > 0) {
+            maxima.push_back(stats[j].max);
+        }
+    }
+    if (maxima.empty()) {
+        return 0.0;
+    }
+    percentile = std::min(std::max(percentile, 0.f), 100.f);
+    auto nth = maxima.begin() + (int)std::lround(percentile / 100.f * (maxima.size() - 1));
+    std::nth_element(maxima.begin(), nth, maxima.end());
+    return std::max(*nth, 0.f);
+}
@@ -3,25 +3,72 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+
+#include "DataSource.hpp"
+
+class CSVReader : public DataSource {
+    public:
+        // Read-only view over the parsed values of one column (no copy is made).
+        // It stays valid as long as the CSVReader it comes from is alive.
+        struct Column {
+            const float *values;
+            int size;
+
+            const float &operator[](int i) const { return values[i]; }
+            const float *begin() const { return values; }
+            const float *end() const { return values + size; }
+        };
+
+        // Summary of the numeric cells of one column, computed once at load
+        struct ColumnStats {
+            float min;      // +inf if the column has no numbers
+            float max;      // -inf if the column has no numbers
+            double sum;
+            int count;      // number of cells that are numbers
+        };
 
-class CSVReader {
     private:
         std::string filename;
         char delimiter;
         int numVariables;
+        int numLines;
         std::vector<std::string> variableNames;
-        std::vector<std::vector<std::string>> data;
+        std::vector<std::string> labels;            // first column kept as text (e.g. the dates of the time steps)
+        const float *values;                        // column after column, numLines values each, NaN where a cell is not a number
+        std::shared_ptr<const void> storage;        // owns values (parsed buffer or mapped snapshot), shared by copies
+        std::vector<ColumnStats> stats;
 
-        void readHeader();
-        void readData();
+        const char *readHeader(const char *begin, const char *end);
+        void readData(const char *begin, const char *end);
+        void parseLines(const char *begin, const char *end, int firstLine, float *columns);
+        void computeStats();
+        bool readSnapshot(const std::string &snapshotName);
+        void writeSnapshot(const std::string &snapshotName) const;
+        std::vector<bool> includedColumns(int *excludeColumns, int numExcludeColumns) const;
 
     public:
-        CSVReader(std::string filename, char delimiter=',');
-        int getNumVariables() const;
-        std::vector<std::string> getVariableNames() const;
-        std::vector<std::string> getLine(int lineNumber) const;
-        int getNumLines() const;
-        float getMaxValue(int *excludeColumns = NULL, int numExcludeColumns = 0) const;
+        // useSnapshot: reuse (or create) the binary snapshot "<filename>.bin" instead of parsing the text every time
+        CSVReader(std::string filename, char delimiter=',', bool useSnapshot=true);
+        int getNumVariables() const override;
+        const std::vector<std::string> &getVariableNames() const override;
+        const std::string &getLabel(int lineNumber) const override;
+        Column getColumn(int columnNumber) const;
+        float getValue(int lineNumber, int columnNumber) const override;
+        int getNumLines() const override;
+        const ColumnStats &getColumnStats(int columnNumber) const;
+        float getMaxValue(int *excludeColumns = NULL, int numExcludeColumns = 0) const override;
+        float getMaxValuePercentile(float percentile, int *excludeColumns = NULL, int numExcludeColumns = 0) const;
+
+        // Statistics of numVariables columns of numLines values each, one after the other (as getColumn),
+        // reduced in parallel
+        static void computeStats(const float *values, int numLines, int numVariables, ColumnStats *stats);
+
+        // Splits one line (its '\n' excluded) at every delimiter
+        static std::vector<std::string> splitLine(const char *begin, const char *end, char delimiter);
+        // Parses the first numVariables cells of one line (its '\n' excluded): cell j goes to values[j * stride],
+        // NaN if it is missing or not a number. The first cell is also kept as text in label.
+        static void parseLine(const char *begin, const char *end, char delimiter, int numVariables, float *values, size_t stride, std::string &label);
 };
 
 #endif // CSVREADER_HPP
@@ -0,0 +1,240 @@
+#include "CSVStream.hpp"
+#include "CSVReader.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+
+// How long the reader thread waits for new bytes before checking whether it has to stop
+const int POLL_TIMEOUT_MS = 100;
+// A longer line is garbage (or not CSV at all): it is dropped instead of being buffered forever
+const size_t MAX_LINE_LENGTH = 1 << 20;
+// How long the constructor waits for the header and the first line before giving up
+const int FIRST_LINE_TIMEOUT_MS = 10000;
+
+}
+
+CSVStream::CSVStream(std::string source, char delimiter, int historyLines, int ringLines)
+    : source(source), delimiter(delimiter), fd(-1), closesAtEnd(false), numVariables(0), head(0), tail(0), stop(false),
+      historyLines(std::max(1, historyLines)), first(0), numLines(0) {
+    openSource();
+
+    // the chart needs the header and one line to lay out the bars: wait for them, but not forever,
+    // an empty file or a pipe nobody writes to would freeze the caller
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(FIRST_LINE_TIMEOUT_MS);
+    while (numLines == 0) {
+        size_t eol = pending.find('\n');
+        if (eol == std::string::npos) {
+            if (!receive()) {
+                closeSource();
+                throw std::runtime_error("failed to read data from " + source);
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                closeSource();
+                throw std::runtime_error("failed to read data from " + source + ": no header and complete line within " +
+                                         std::to_string(FIRST_LINE_TIMEOUT_MS / 1000) + " s!");
+            }
+            continue;
+        }
+        if (variableNames.empty()) {
+            variableNames = CSVReader::splitLine(pending.data(), pending.data() + eol, delimiter);
+            numVariables = variableNames.size();
+
+            size_t ringSize = 1;
+            while (ringSize < (size_t)std::max(1, ringLines)) ringSize <<= 1;
+            ring.resize(ringSize);
+            for (Row &row : ring) {
+                row.values.resize(numVariables);
+            }
+            history.resize((size_t)this->historyLines * numVariables);
+            labels.resize(this->historyLines);
+            maxValues.assign(numVariables, -std::numeric_limits<float>::infinity());
+        } else {
+            push(pending.data(), pending.data() + eol);
+            update();
+        }
+        pending.erase(0, eol + 1);
+    }
+
+    reader = std::thread(&CSVStream::readLoop, this);
+}
+
+CSVStream::~CSVStream() {
+    stop = true;
+    if (reader.joinable()) {
+        reader.join();
+    }
+    closeSource();
+}
+
+void CSVStream::openSource() {
+    struct stat st;
+    if (source == "-") {
+        fd = STDIN_FILENO;
+        closesAtEnd = true;
+    } else if (stat(source.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (source.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("failed to connect to " + source + ": path too long");
+        }
+        strcpy(address.sun_path, source.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            closeSource();
+            throw std::runtime_error("failed to connect to " + source);
+        }
+        closesAtEnd = true;
+    } else {
+        // non blocking, so that opening a named pipe does not wait for a writer
+        fd = open(source.c_str(), O_RDONLY | O_NONBLOCK);
+        if (fd < 0) {
+            throw std::runtime_error("failed to open " + source);
+        }
+    }
+}
+
+void CSVStream::closeSource() {
+    if (fd >= 0 && fd != STDIN_FILENO) {
+        close(fd);
+    }
+    fd = -1;
+}
+
+// Waits up to POLL_TIMEOUT_MS for new bytes and appends them to pending.
+// Returns false once nothing more can come (closed socket or standard input, read error).
+bool CSVStream::receive() {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0) {
+        return true;
+    }
+    char buffer[1 << 16];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n > 0) {
+        pending.append(buffer, n);
+        return true;
+    }
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (closesAtEnd) {
+        return false;
+    }
+    // end of a file that may still grow, or of a pipe that may get a new writer
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT_MS));
+    return true;
+}
+
+void CSVStream::readLoop() {
+    do {
+        size_t start = 0, eol;
+        while ((eol = pending.find('\n', start)) != std::string::npos) {
+            if (!push(pending.data() + start, pending.data() + eol)) {
+                return;
+            }
+            start = eol + 1;
+        }
+        pending.erase(0, start);
+        if (pending.size() > MAX_LINE_LENGTH) {
+            pending.clear();
+        }
+    } while (!stop && receive());
+}
+
+// Parses one line into the next free slot of the ring, waiting while the ring is full.
+// Returns false if the stream is being destroyed meanwhile.
+bool CSVStream::push(const char *begin, const char *end) {
+    if (end == begin || (end - begin == 1 && *begin == '\r')) {
+        return true;
+    }
+    size_t h = head.load(std::memory_order_relaxed);
+    while (h - tail.load(std::memory_order_acquire) == ring.size()) {
+        if (stop) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    Row &row = ring[h & (ring.size() - 1)];
+    CSVReader::parseLine(begin, end, delimiter, numVariables, row.values.data(), 1, row.label);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+int CSVStream::update() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    int dropped = 0;
+    for (; t != h; t++) {
+        Row &row = ring[t & (ring.size() - 1)];
+        int slot;
+        if (numLines < historyLines) {
+            slot = (first + numLines) % historyLines;
+            numLines++;
+        } else {
+            slot = first;
+            first = (first + 1) % historyLines;
+            dropped++;
+        }
+        std::copy(row.values.begin(), row.values.end(), history.begin() + (size_t)slot * numVariables);
+        // the slot label goes back to the ring, whose string is overwritten by the next line anyway
+        labels[slot].swap(row.label);
+        for (int j = 0; j < numVariables; j++) {
+            if (row.values[j] > maxValues[j]) {
+                maxValues[j] = row.values[j];
+            }
+        }
+    }
+    tail.store(t, std::memory_order_release);
+    return dropped;
+}
+
+int CSVStream::getNumVariables() const {
+    return numVariables;
+}
+
+const std::vector<std::string> &CSVStream::getVariableNames() const {
+    return variableNames;
+}
+
+int CSVStream::getNumLines() const {
+    return numLines;
+}
+
+const std::string &CSVStream::getLabel(int lineNumber) const {
+    return labels[(first + lineNumber) % historyLines];
+}
+
+float CSVStream::getValue(int lineNumber, int columnNumber) const {
+    return history[(size_t)((first + lineNumber) % historyLines) * numVariables + columnNumber];
+}
+
+float CSVStream::getMaxValue(int *excludeColumns, int numExcludeColumns) const {
+    float maxValue = 0.0;
+    for (int j = 0; j < numVariables; j++) {
+        if (std::find(excludeColumns, excludeColumns + numExcludeColumns, j) == excludeColumns + numExcludeColumns &&
+            maxValues[j] > maxValue) {
+            maxValue = maxValues[j];
+        }
+    }
+    return maxValue;
+}
+
+bool CSVStream::isLive() const {
+    return true;
+}
+
+int CSVStream::getMaxLines() const {
+    return historyLines;
+}
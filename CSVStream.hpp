@@ -0,0 +1,68 @@
+#ifndef CSVSTREAM_HPP
+#define CSVSTREAM_HPP
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+
+#include "DataSource.hpp"
+
+// Live CSV data: a file that keeps being appended to, a named pipe, a UNIX socket or "-" for the standard input.
+// A reader thread parses every new line and hands it to the render loop through a lock-free ring,
+// the chart then sees the last historyLines lines only, so memory stays bounded however long it runs.
+class CSVStream : public DataSource {
+    private:
+        // One parsed line waiting in the ring
+        struct Row {
+            std::vector<float> values;
+            std::string label;
+        };
+
+        std::string source;
+        char delimiter;
+        int fd;
+        bool closesAtEnd;                           // socket or standard input: no more data after the end
+        int numVariables;
+        std::vector<std::string> variableNames;
+        std::string pending;                        // bytes received after the last complete line (reader thread only)
+
+        // single producer (reader thread), single consumer (render loop)
+        std::vector<Row> ring;                      // power of two slots, preallocated
+        std::atomic<size_t> head;                   // next slot written by the reader thread
+        std::atomic<size_t> tail;                   // next slot taken by update()
+        std::atomic<bool> stop;
+        std::thread reader;
+
+        // lines visible to the chart (render loop only): circular window, oldest line in slot first
+        int historyLines;
+        int first;
+        int numLines;
+        std::vector<float> history;                 // line after line, numVariables values each
+        std::vector<std::string> labels;
+        std::vector<float> maxValues;               // highest value ever received in each column
+
+        void openSource();
+        void closeSource();
+        bool receive();
+        void readLoop();
+        bool push(const char *begin, const char *end);
+
+    public:
+        CSVStream(std::string source, char delimiter=',', int historyLines=4096, int ringLines=1024);
+        ~CSVStream();
+        CSVStream(const CSVStream &) = delete;
+        CSVStream &operator=(const CSVStream &) = delete;
+
+        int getNumVariables() const override;
+        const std::vector<std::string> &getVariableNames() const override;
+        int getNumLines() const override;
+        const std::string &getLabel(int lineNumber) const override;
+        float getValue(int lineNumber, int columnNumber) const override;
+        float getMaxValue(int *excludeColumns = NULL, int numExcludeColumns = 0) const override;
+        bool isLive() const override;
+        int getMaxLines() const override;
+        int update() override;
+};
+
+#endif // CSVSTREAM_HPP
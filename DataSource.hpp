@@ -0,0 +1,31 @@
+#ifndef DATASOURCE_HPP
+#define DATASOURCE_HPP
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Time series shown by the charts: one line per time step, the first column holds the labels
+// (e.g. the dates) and the other ones the values of the bars.
+class DataSource {
+    public:
+        virtual ~DataSource() {}
+
+        virtual int getNumVariables() const = 0;
+        virtual const std::vector<std::string> &getVariableNames() const = 0;
+        virtual int getNumLines() const = 0;
+        virtual const std::string &getLabel(int lineNumber) const = 0;
+        virtual float getValue(int lineNumber, int columnNumber) const = 0;
+        virtual float getMaxValue(int *excludeColumns = NULL, int numExcludeColumns = 0) const = 0;
+
+        // A live source keeps receiving new lines after it is opened
+        virtual bool isLive() const { return false; }
+        // Most lines kept at the same time: a live source reuses the place of the lines it drops,
+        // line n being stored at (number of lines dropped so far + n) % getMaxLines()
+        virtual int getMaxLines() const { return getNumLines(); }
+        // Called once per frame by the render loop: takes in the lines received since the last call.
+        // Returns how many of the oldest lines were dropped to make room, so line numbers can be shifted.
+        virtual int update() { return 0; }
+};
+
+#endif // DATASOURCE_HPP
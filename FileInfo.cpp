@@ -0,0 +1,19 @@
+#include "FileInfo.hpp"
+
+#include <sys/stat.h>
+
+bool fileInfo(const std::string &filename, uint64_t &size, int64_t &mtime) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+#if defined(__APPLE__)
+    mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    mtime = st.st_mtime * 1000000000LL;
+#else
+    mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
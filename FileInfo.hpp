@@ -0,0 +1,11 @@
+#ifndef FILEINFO_HPP
+#define FILEINFO_HPP
+
+#include <string>
+#include <cstdint>
+
+// Size and modification time (nanoseconds) of a file, false if it does not exist. The caches (CSV snapshots,
+// font atlas, map tiles) keep them to tell whether they are older than their source.
+bool fileInfo(const std::string &filename, uint64_t &size, int64_t &mtime);
+
+#endif // FILEINFO_HPP
@@ -0,0 +1,200 @@
+#include "FontAtlas.hpp"
+#include "FileInfo.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+
+// ImGui compiles its own copy, static as well
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imgui/imstb_truetype.h"
+
+namespace {
+
+// Cache layout: CacheHeader, CharData[NUM_CHARS], then the WIDTH x height pixels, row after row
+const char CACHE_MAGIC[8] = {'S', 'D', 'F', 'A', 'T', 'L', 'A', 'S'};
+const uint32_t CACHE_VERSION = 1;
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    int32_t pixelHeight;
+    int32_t padding;
+    int32_t width;
+    int32_t height;
+    int32_t lineHeight;
+    int32_t numChars;
+};
+
+}
+
+FontAtlas::FontAtlas(const std::string &fontFile, int pixelHeight, bool useCache) : fontFile(fontFile), pixelHeight(pixelHeight) {
+    std::string cacheName = fontFile + ".sdf";
+    if (useCache && readCache(cacheName)) {
+        return;
+    }
+    generate();
+    if (useCache) {
+        writeCache(cacheName);
+    }
+}
+
+// Rasterizes the distance field of every glyph, then places them in rows, one pixel apart, in an atlas
+// WIDTH pixels wide and as high as needed (a power of two)
+void FontAtlas::generate() {
+    std::ifstream file(fontFile, std::ios::binary);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    stbtt_fontinfo info;
+    if (data.empty() || !stbtt_InitFont(&info, data.data(), stbtt_GetFontOffsetForIndex(data.data(), 0))) {
+        throw std::runtime_error("failed to load font " + fontFile + "!");
+    }
+    float scale = stbtt_ScaleForPixelHeight(&info, (float)pixelHeight);
+    int ascent, descent, lineGap;
+    stbtt_GetFontVMetrics(&info, &ascent, &descent, &lineGap);
+    lineHeight = (int)std::lround((ascent - descent + lineGap) * scale);
+    int baseline = (int)std::lround(ascent * scale);
+
+    std::vector<unsigned char *> bitmaps(NUM_CHARS);
+    glyphs.assign(NUM_CHARS, CharData{});
+    int x = 0, y = 0, rowHeight = 0;
+    for (int i = 0; i < NUM_CHARS; i++) {
+        CharData &d = glyphs[i];
+        int advance, leftBearing;
+        stbtt_GetCodepointHMetrics(&info, FIRST_CHAR + i, &advance, &leftBearing);
+        d.xadvance = (int)std::lround(advance * scale);
+        // nullptr, and no size, for the glyphs with nothing to draw (the space)
+        bitmaps[i] = stbtt_GetCodepointSDF(&info, scale, FIRST_CHAR + i, PADDING, ONEDGE, (float)ONEDGE / PADDING,
+                                           &d.width, &d.height, &d.xoffset, &d.yoffset);
+        if (!bitmaps[i]) {
+            d.width = d.height = d.xoffset = d.yoffset = 0;
+            continue;
+        }
+        d.yoffset += baseline;
+        if (x + d.width > WIDTH) {
+            x = 0;
+            y += rowHeight + 1;
+            rowHeight = 0;
+        }
+        d.x = x;
+        d.y = y;
+        x += d.width + 1;
+        rowHeight = std::max(rowHeight, d.height);
+    }
+    for (height = 1; height < y + rowHeight; height *= 2) {
+    }
+
+    pixels.assign((size_t)WIDTH * height, 0);
+    for (int i = 0; i < NUM_CHARS; i++) {
+        const CharData &d = glyphs[i];
+        for (int row = 0; row < d.height; row++) {
+            memcpy(&pixels[(size_t)(d.y + row) * WIDTH + d.x], bitmaps[i] + row * d.width, d.width);
+        }
+        stbtt_FreeSDF(bitmaps[i], nullptr);
+    }
+}
+
+// Returns false, leaving the atlas untouched, if the cache is missing, unreadable, older than the font
+// or rendered with other parameters
+bool FontAtlas::readCache(const std::string &cacheName) {
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!fileInfo(fontFile, sourceSize, sourceMtime)) {
+        return false;
+    }
+    std::ifstream file(cacheName, std::ios::binary);
+    CacheHeader header;
+    if (!file.read((char *)&header, sizeof(header))) {
+        return false;
+    }
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION || header.byteOrder != CACHE_BYTE_ORDER ||
+        header.sourceSize != sourceSize || header.sourceMtime != sourceMtime ||
+        header.pixelHeight != pixelHeight || header.padding != PADDING ||
+        header.width != WIDTH || header.numChars != NUM_CHARS || header.height <= 0 || header.height > 1 << 16) {
+        return false;
+    }
+    std::vector<CharData> cachedGlyphs(NUM_CHARS);
+    std::vector<unsigned char> cachedPixels((size_t)WIDTH * header.height);
+    if (!file.read((char *)cachedGlyphs.data(), NUM_CHARS * sizeof(CharData)) ||
+        !file.read((char *)cachedPixels.data(), cachedPixels.size())) {
+        return false;
+    }
+    height = header.height;
+    lineHeight = header.lineHeight;
+    glyphs.swap(cachedGlyphs);
+    pixels.swap(cachedPixels);
+    return true;
+}
+
+// Best effort, as the snapshots of CSVReader: written under a temporary name and renamed
+void FontAtlas::writeCache(const std::string &cacheName) const {
+    CacheHeader header{};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.byteOrder = CACHE_BYTE_ORDER;
+    if (!fileInfo(fontFile, header.sourceSize, header.sourceMtime)) {
+        return;
+    }
+    header.pixelHeight = pixelHeight;
+    header.padding = PADDING;
+    header.width = WIDTH;
+    header.height = height;
+    header.lineHeight = lineHeight;
+    header.numChars = NUM_CHARS;
+
+    std::string tmpName = cacheName + ".tmp";
+    FILE *out = fopen(tmpName.c_str(), "wb");
+    if (!out) {
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(glyphs.data(), sizeof(CharData), NUM_CHARS, out) == (size_t)NUM_CHARS;
+    ok = ok && fwrite(pixels.data(), 1, pixels.size(), out) == pixels.size();
+    ok = (fclose(out) == 0) && ok;
+    if (ok) {
+        std::remove(cacheName.c_str());
+        ok = std::rename(tmpName.c_str(), cacheName.c_str()) == 0;
+    }
+    if (!ok) {
+        std::remove(tmpName.c_str());
+    }
+}
+
+int FontAtlas::getWidth() const {
+    return WIDTH;
+}
+
+int FontAtlas::getHeight() const {
+    return height;
+}
+
+const unsigned char *FontAtlas::getPixels() const {
+    return pixels.data();
+}
+
+int FontAtlas::getLineHeight() const {
+    return lineHeight;
+}
+
+GlyphTable FontAtlas::getGlyphTable(float lineHeight) const {
+    GlyphTable table;
+    for (int c = 0; c < 256; c++) {
+        int i = c - FIRST_CHAR;
+        table.glyphs[c] = (i >= 0 && i < (int)glyphs.size()) ? &glyphs[i] : nullptr;
+    }
+    table.lineHeight = lineHeight;
+    table.scale = lineHeight / this->lineHeight;
+    table.texW = WIDTH;
+    table.texH = height;
+    return table;
+}
@@ -0,0 +1,47 @@
+#ifndef FONTATLAS_HPP
+#define FONTATLAS_HPP
+
+#include "TextLayout.hpp"
+
+#include <string>
+#include <vector>
+
+// Signed distance field of the printable ASCII characters of a TrueType font, in a single 8-bit channel:
+// ONEDGE on the outline of the glyphs, growing inside, down to 0 at PADDING pixels outside. Rendered once
+// at pixelHeight, the same atlas draws the texts crisp at any size (see shaders/Text.frag).
+// It is generated from the font the first time and cached in "<fontFile>.sdf" for the next runs.
+class FontAtlas {
+    public:
+        static const int FIRST_CHAR = 32;
+        static const int NUM_CHARS = 95;
+        static const int PADDING = 8;
+        static const int ONEDGE = 128;
+        static const int WIDTH = 512;
+
+    private:
+        std::string fontFile;
+        int pixelHeight;
+        int height;
+        int lineHeight;
+        std::vector<CharData> glyphs;
+        std::vector<unsigned char> pixels;
+
+        void generate();
+        bool readCache(const std::string &cacheName);
+        void writeCache(const std::string &cacheName) const;
+
+    public:
+        FontAtlas() : pixelHeight(0), height(0), lineHeight(0) {}
+        // useCache: reuse (or create) the cached atlas instead of rasterizing the font every time
+        FontAtlas(const std::string &fontFile, int pixelHeight = 48, bool useCache = true);
+
+        int getWidth() const;
+        int getHeight() const;
+        const unsigned char *getPixels() const;
+        int getLineHeight() const;
+
+        // The glyphs scaled to lines of lineHeight pixels, pointing into this atlas
+        GlyphTable getGlyphTable(float lineHeight) const;
+};
+
+#endif // FONTATLAS_HPP
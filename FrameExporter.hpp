@@ -0,0 +1,127 @@
+#ifndef FRAMEEXPORTER_HPP
+#define FRAMEEXPORTER_HPP
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include <stb_image_write.h>
+
+// Saves the exported frames as PNG files, encoded by a pool of worker threads:
+// the render loop only copies the pixels of a frame and goes on.
+// The implementation of stb_image_write comes with Starter.hpp.
+class FrameExporter {
+    private:
+        struct Frame {
+            int number;
+            std::vector<unsigned char> pixels;
+        };
+
+        std::string pattern;                        // printf format of the file names, given the frame number
+        int width, height;
+        size_t maxPending;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable frameAdded;
+        std::condition_variable frameTaken;
+        std::deque<Frame> pending;                  // waiting to be encoded
+        std::vector<std::vector<unsigned char>> spare;  // pixel buffers of the encoded frames, reused
+        int encoding;
+        bool stop;
+        std::string error;
+
+        void encodeLoop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                frameAdded.wait(lock, [this] { return stop || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                Frame frame = std::move(pending.front());
+                pending.pop_front();
+                encoding++;
+                frameTaken.notify_all();
+                lock.unlock();
+
+                char fileName[4096];
+                snprintf(fileName, sizeof(fileName), pattern.c_str(), frame.number);
+                bool written = stbi_write_png(fileName, width, height, 4, frame.pixels.data(), width * 4) != 0;
+
+                lock.lock();
+                encoding--;
+                if (!written && error.empty()) {
+                    error = std::string("failed to write ") + fileName + "!";
+                }
+                spare.push_back(std::move(frame.pixels));
+                frameTaken.notify_all();
+            }
+        }
+
+    public:
+        // threads: encoders (0 for one per core). At most maxPending frames wait for them (0 for twice
+        // the encoders), beyond that add() waits: otherwise memory would grow without bounds
+        FrameExporter(std::string pattern, int width, int height, int threads = 0, int maxPending = 0)
+            : pattern(pattern), width(width), height(height), encoding(0), stop(false) {
+            if (threads <= 0) {
+                threads = std::max(1, (int)std::thread::hardware_concurrency());
+            }
+            this->maxPending = maxPending > 0 ? maxPending : 2 * threads;
+            for (int t = 0; t < threads; t++) {
+                workers.push_back(std::thread(&FrameExporter::encodeLoop, this));
+            }
+        }
+
+        ~FrameExporter() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            frameAdded.notify_all();
+            for (std::thread &worker : workers) {
+                worker.join();
+            }
+        }
+
+        FrameExporter(const FrameExporter &) = delete;
+        FrameExporter &operator=(const FrameExporter &) = delete;
+
+        // Queues a copy of the RGBA pixels (width * height * 4 bytes, rows from the top) of frame number
+        void add(int number, const void *pixels) {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameTaken.wait(lock, [this] { return pending.size() < maxPending; });
+            Frame frame;
+            frame.number = number;
+            if (!spare.empty()) {
+                frame.pixels = std::move(spare.back());
+                spare.pop_back();
+            }
+            lock.unlock();
+
+            // copied outside of the lock: the encoders can go on meanwhile
+            frame.pixels.resize((size_t)width * height * 4);
+            memcpy(frame.pixels.data(), pixels, frame.pixels.size());
+
+            lock.lock();
+            pending.push_back(std::move(frame));
+            frameAdded.notify_one();
+        }
+
+        // Waits until every frame is written
+        void finish() {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameTaken.wait(lock, [this] { return pending.empty() && encoding == 0; });
+            if (!error.empty()) {
+                throw std::runtime_error(error);
+            }
+        }
+};
+
+#endif // FRAMEEXPORTER_HPP
@@ -54,7 +54,8 @@ struct HudMaker {
 		M.createVertexBuffer();
 		M.createIndexBuffer();
 
-		T.init(BP, "textures/HudObj.png");
+		// shown once loaded: the window does not wait for it
+		T.initAsync(BP, "textures/HudObj.png");
 	}
 
 	void createHudMesh() {
@@ -98,13 +99,15 @@ struct HudMaker {
 	}
 	
     void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, int curText = 0) {
+		if (!T.ready) {
+			return;
+		}
     	P.bind(commandBuffer);
 		M.bind(commandBuffer);
 		
 		DS.bind(commandBuffer, P, 0, currentImage);
 
-		vkCmdDrawIndexed(commandBuffer,
-						static_cast<uint32_t>(M.indices.size()), 1, 0, 0, 0);
+		BP->drawIndexed(commandBuffer, static_cast<uint32_t>(M.indices.size()));
 			
 	}
 
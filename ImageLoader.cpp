@@ -0,0 +1,159 @@
+#include "ImageLoader.hpp"
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+// The implementation is compiled with Starter.hpp
+#include <stb_image.h>
+
+namespace {
+
+float srgbToLinear(unsigned char c) {
+    float v = c / 255.0f;
+    return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+unsigned char linearToSrgb(float v) {
+    v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+    return (unsigned char)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+}
+
+}
+
+int mipLevelsOf(int width, int height) {
+    return (int)std::floor(std::log2(std::max(width, height))) + 1;
+}
+
+size_t mipChainSize(int width, int height) {
+    return mipLevelOffset(width, height, mipLevelsOf(width, height));
+}
+
+size_t mipLevelOffset(int width, int height, int level) {
+    size_t offset = 0;
+    for (int l = 0; l < level; l++) {
+        offset += (size_t)width * height * 4;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return offset;
+}
+
+// The same sizes as the blits of BaseProject::generateMipmaps: the last row or column of an odd level is dropped
+void buildMipChain(unsigned char *pixels, int width, int height, bool srgb) {
+    float toLinear[256];
+    for (int c = 0; c < 256; c++) {
+        toLinear[c] = srgb ? srgbToLinear((unsigned char)c) : c / 255.0f;
+    }
+    int levels = mipLevelsOf(width, height);
+    unsigned char *src = pixels;
+    for (int l = 1; l < levels; l++) {
+        int w = std::max(width / 2, 1);
+        int h = std::max(height / 2, 1);
+        unsigned char *dst = src + (size_t)width * height * 4;
+        for (int y = 0; y < h; y++) {
+            int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int x = 0; x < w; x++) {
+                int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                const unsigned char *p[4] = {
+                    src + ((size_t)y0 * width + x0) * 4, src + ((size_t)y0 * width + x1) * 4,
+                    src + ((size_t)y1 * width + x0) * 4, src + ((size_t)y1 * width + x1) * 4
+                };
+                unsigned char *q = dst + ((size_t)y * w + x) * 4;
+                for (int k = 0; k < 3; k++) {
+                    float v = (toLinear[p[0][k]] + toLinear[p[1][k]] + toLinear[p[2][k]] + toLinear[p[3][k]]) / 4;
+                    q[k] = srgb ? linearToSrgb(v) : (unsigned char)std::lround(v * 255.0f);
+                }
+                q[3] = (unsigned char)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+            }
+        }
+        src = dst;
+        width = w;
+        height = h;
+    }
+}
+
+ImageLoader::ImageLoader(int numWorkers) : busy(0), stop(false) {
+    if (numWorkers <= 0) {
+        numWorkers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+    for (int t = 0; t < numWorkers; t++) {
+        workers.push_back(std::thread(&ImageLoader::workLoop, this));
+    }
+}
+
+ImageLoader::~ImageLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : workers) {
+        t.join();
+    }
+    for (Image &image : done) {
+        freePixels(image.pixels);
+    }
+}
+
+void ImageLoader::load(int id, const std::string &file, bool srgb) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(Job{id, file, srgb});
+    }
+    wake.notify_one();
+}
+
+bool ImageLoader::take(Image &image) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (done.empty()) {
+        return false;
+    }
+    image = done.back();
+    done.pop_back();
+    return true;
+}
+
+void ImageLoader::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return jobs.empty() && busy == 0; });
+}
+
+// stb_image allocates with malloc
+void ImageLoader::freePixels(unsigned char *pixels) {
+    free(pixels);
+}
+
+void ImageLoader::workLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stop || !jobs.empty(); });
+        if (stop) {
+            return;
+        }
+        Job job = jobs.front();
+        jobs.erase(jobs.begin());
+        busy++;
+        lock.unlock();
+
+        Image image{job.id, 0, 0, nullptr};
+        int channels;
+        image.pixels = stbi_load(job.file.c_str(), &image.width, &image.height, &channels, STBI_rgb_alpha);
+        if (image.pixels) {
+            // the mip levels go after the image
+            unsigned char *chain = (unsigned char *)realloc(image.pixels, mipChainSize(image.width, image.height));
+            if (chain) {
+                image.pixels = chain;
+                buildMipChain(image.pixels, image.width, image.height, job.srgb);
+            } else {
+                stbi_image_free(image.pixels);
+                image.pixels = nullptr;
+            }
+        }
+
+        lock.lock();
+        done.push_back(image);
+        busy--;
+        idle.notify_all();
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef IMAGELOADER_HPP
+#define IMAGELOADER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Mip levels of a width x height image, down to 1 x 1: each half the size of the previous one
+int mipLevelsOf(int width, int height);
+// Bytes of an RGBA image and of all its mip levels, one after the other
+size_t mipChainSize(int width, int height);
+// Offset of a mip level in such a chain
+size_t mipLevelOffset(int width, int height, int level);
+// Fills the mip levels following level 0, at the beginning of pixels (mipChainSize bytes), each averaging 2 x 2
+// pixels of the previous one. srgb: the colors are averaged as linear values, as the GPU does for sRGB images.
+void buildMipChain(unsigned char *pixels, int width, int height, bool srgb);
+
+// Decodes image files on a pool of worker threads, off the render loop: the images are taken back as they are
+// done, RGBA with their mip chain, ready to be copied in a texture as they are.
+class ImageLoader {
+    public:
+        struct Image {
+            int id;                                 // given to load
+            int width;
+            int height;
+            unsigned char *pixels;                  // mip chain, nullptr if the file could not be read;
+                                                    // freed with freePixels once copied
+        };
+
+    private:
+        struct Job {
+            int id;
+            std::string file;
+            bool srgb;
+        };
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::vector<Job> jobs;
+        std::vector<Image> done;
+        int busy;                                   // jobs taken by the workers and not done yet
+        bool stop;
+        std::vector<std::thread> workers;
+
+        void workLoop();
+
+    public:
+        // numWorkers: 0 for a worker per core, leaving one to the render loop
+        explicit ImageLoader(int numWorkers = 0);
+        ~ImageLoader();
+        ImageLoader(const ImageLoader &) = delete;
+        ImageLoader &operator=(const ImageLoader &) = delete;
+
+        void load(int id, const std::string &file, bool srgb);
+        // An image decoded since the last calls, false if none is. Never allocates.
+        bool take(Image &image);
+        // Blocks until every image asked for is decoded
+        void waitIdle();
+        static void freePixels(unsigned char *pixels);
+};
+
+#endif // IMAGELOADER_HPP
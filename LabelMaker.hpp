@@ -0,0 +1,170 @@
+// Labels floating over points of the scene, e.g. the name of each bar over its top. Every glyph of every
+// label is an instance of the same quad, all drawn at once: an instance carries the anchor of its label, in
+// world space, and the place of its glyph in the label, in pixels. The vertex shader projects the anchor and
+// moves the glyph from there on the screen, so the labels always face the camera and keep their size in
+// pixels at any distance. An anchor can follow the top of a bar, from the values the bars are drawn with.
+
+struct LabelCorner {
+	glm::vec2 corner;
+};
+
+struct LabelGlyph {
+	glm::vec3 anchor;
+	int bar;				// -1: the anchor does not follow a bar
+	glm::vec2 offset;		// of the top left corner of the glyph from the anchor, in pixels
+	glm::vec2 size;			// in pixels
+	glm::vec4 uv;			// top left and bottom right corners in the atlas
+};
+
+struct LabelUniformBlock {
+	alignas(8) glm::vec2 pixelSize;		// of a pixel of the window, in clip space
+	alignas(4) float lift;				// world units between the anchors and the labels
+};
+
+extern std::string shaderDir;
+
+struct LabelMaker {
+	VertexDescriptor VD;
+
+	BaseProject *BP;
+	TextMaker *txt;
+
+	DescriptorSetLayout DSL;
+	Pipeline P;
+	Model<LabelCorner> M;
+	DescriptorSet DS;
+	InstanceBuffer I;
+
+	LabelUniformBlock ubo_lbl;
+
+	GlyphTable font;
+	std::vector<LabelGlyph> glyphs;
+
+	// The atlas of txt, at lines of size pixels. DSL_bars: the layout of the values of the bars and of
+	// their transform (see ShaderBarInstanced.vert), bound as set 1 when drawing.
+	void init(BaseProject *_BP, TextMaker *_txt, DescriptorSetLayout *DSL_bars, float size) {
+		BP = _BP;
+		txt = _txt;
+		font = txt->atlas.getGlyphTable(size);
+		glyphs.clear();
+		ubo_lbl.lift = 0.2f;
+		createLabelDescriptorSetAndVertexLayout();
+		createLabelPipeline(DSL_bars);
+		createLabelModel();
+	}
+
+	void createLabelDescriptorSetAndVertexLayout() {
+		VD.init(BP, {
+				  {0, sizeof(LabelCorner), VK_VERTEX_INPUT_RATE_VERTEX},
+				  {1, sizeof(LabelGlyph), VK_VERTEX_INPUT_RATE_INSTANCE}
+				}, {
+				  {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(LabelCorner, corner),
+				         sizeof(glm::vec2), OTHER},
+				  {1, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(LabelGlyph, anchor),
+				         sizeof(glm::vec3), OTHER},
+				  {1, 2, VK_FORMAT_R32_SINT, offsetof(LabelGlyph, bar),
+				         sizeof(int), OTHER},
+				  {1, 3, VK_FORMAT_R32G32_SFLOAT, offsetof(LabelGlyph, offset),
+				         sizeof(glm::vec2), OTHER},
+				  {1, 4, VK_FORMAT_R32G32_SFLOAT, offsetof(LabelGlyph, size),
+				         sizeof(glm::vec2), OTHER},
+				  {1, 5, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(LabelGlyph, uv),
+				         sizeof(glm::vec4), OTHER}
+				});
+		DSL.init(BP,
+				{{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT},
+				{1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS},});
+	}
+
+	// drawn in the scene: hidden by what is in front of the anchors
+	void createLabelPipeline(DescriptorSetLayout *DSL_bars) {
+		P.init(BP, &VD, shaderDir + "Label.vert.spv", shaderDir + "Text.frag.spv", {&DSL, DSL_bars});
+		P.setAdvancedFeatures(VK_COMPARE_OP_LESS_OR_EQUAL, VK_POLYGON_MODE_FILL,
+									VK_CULL_MODE_NONE, true);
+	}
+
+	void createLabelModel() {
+		M.vertices = {{{0.0f, 0.0f}}, {{1.0f, 0.0f}}, {{0.0f, 1.0f}}, {{1.0f, 1.0f}}};
+		M.indices = {0, 1, 2, 1, 3, 2};
+		M.initMesh(BP, &VD);
+	}
+
+	// A line of text centered over anchor, over the top of the bar-th bar if bar is not -1 (anchor is then
+	// its base). Labels are added before pipelinesAndDescriptorSetsInit.
+	void addLabel(const char *text, glm::vec3 anchor, int bar = -1) {
+		float width = 0;
+		for(const char *s = text; *s; s++) {
+			const CharData *d = font.glyphs[(unsigned char)*s];
+			width += d ? d->xadvance * font.scale : 0;
+		}
+		float x = -width / 2;
+		float y = -font.lineHeight;
+		for(const char *s = text; *s; s++) {
+			const CharData *d = font.glyphs[(unsigned char)*s];
+			if(!d) {
+				continue;
+			}
+			if(d->width > 0) {
+				LabelGlyph g;
+				g.anchor = anchor;
+				g.bar = bar;
+				g.offset = {x + d->xoffset * font.scale, y + d->yoffset * font.scale};
+				g.size = {d->width * font.scale, d->height * font.scale};
+				g.uv = {(float)d->x / font.texW, (float)d->y / font.texH,
+						(float)(d->x + d->width) / font.texW, (float)(d->y + d->height) / font.texH};
+				glyphs.push_back(g);
+			}
+			x += d->xadvance * font.scale;
+		}
+	}
+
+	void pipelinesAndDescriptorSetsInit() {
+		P.create();
+		DS.init(BP, &DSL, {
+					{0, TEXTURE, 0, &txt->T},
+					{1, UNIFORM, sizeof(LabelUniformBlock), nullptr}
+				});
+		if(!glyphs.empty()) {
+			I.init(BP, glyphs.size() * sizeof(LabelGlyph));
+			for(size_t i = 0; i < BP->swapChainImages.size(); i++) {
+				I.map(i, glyphs.data(), glyphs.size() * sizeof(LabelGlyph));
+			}
+		}
+	}
+
+	void pipelinesAndDescriptorSetsCleanup() {
+		P.cleanup();
+		DS.cleanup();
+		if(!glyphs.empty()) {
+			I.cleanup();
+		}
+	}
+
+	void localCleanup() {
+		M.cleanup();
+		DSL.cleanup();
+
+		P.destroy();
+	}
+
+	// Every label, with a single draw. DS_bars: the set of the values and of the transform of the bars.
+	void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, DescriptorSet &DS_bars) {
+		if(glyphs.empty()) {
+			return;
+		}
+		P.bind(commandBuffer);
+		M.bind(commandBuffer);
+		I.bind(commandBuffer, 1, currentImage);
+
+		DS.bind(commandBuffer, P, 0, currentImage);
+		DS_bars.bind(commandBuffer, P, 1, currentImage);
+
+		BP->drawIndexed(commandBuffer, static_cast<uint32_t>(M.indices.size()), static_cast<uint32_t>(glyphs.size()));
+	}
+
+	void update(uint32_t currentImage, int h, int w) {
+		ubo_lbl.pixelSize = glm::vec2(2.0f / w, 2.0f / h);
+
+		DS.map(currentImage, &ubo_lbl, sizeof(ubo_lbl), 1);
+	}
+};
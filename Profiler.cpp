@@ -0,0 +1,109 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+Profiler &Profiler::getInstance() {
+    static Profiler instance;
+    return instance;
+}
+
+int Profiler::getSection(const std::string &name, bool gpu) {
+    std::unordered_map<std::string, int>::iterator found = indices.find(name);
+    if (found != indices.end()) {
+        return found->second;
+    }
+    Section section;
+    section.name = name;
+    section.gpu = gpu;
+    section.history.assign(HISTORY, 0.0f);
+    section.next = 0;
+    section.count = 0;
+    section.total = 0;
+    section.min = std::numeric_limits<float>::infinity();
+    section.max = 0;
+    section.bins.assign(NUM_BINS, 0);
+    sections.push_back(std::move(section));
+    indices[name] = sections.size() - 1;
+    return sections.size() - 1;
+}
+
+void Profiler::add(int section, float milliseconds) {
+    Section &s = sections[section];
+    s.history[s.next] = milliseconds;
+    s.next = (s.next + 1) % HISTORY;
+    s.count++;
+    s.total += milliseconds;
+    s.min = std::min(s.min, milliseconds);
+    s.max = std::max(s.max, milliseconds);
+    s.bins[std::min(std::max((int)(milliseconds / BIN_WIDTH), 0), NUM_BINS - 1)]++;
+}
+
+const std::vector<Profiler::Section> &Profiler::getSections() const {
+    return sections;
+}
+
+float Profiler::getRecentMean(int section) const {
+    const Section &s = sections[section];
+    int n = (int)std::min(s.count, (long long)HISTORY);
+    if (n == 0) {
+        return 0;
+    }
+    float total = 0;
+    for (int k = 1; k <= n; k++) {
+        total += s.history[(s.next - k + HISTORY) % HISTORY];
+    }
+    return total / n;
+}
+
+float Profiler::getPercentile(int section, float p) const {
+    const Section &s = sections[section];
+    if (s.count == 0) {
+        return 0;
+    }
+    long long rank = std::max(1LL, (long long)(p * s.count + 0.5));
+    long long seen = 0;
+    int b = 0;
+    for (; b < NUM_BINS - 1; b++) {
+        seen += s.bins[b];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    // middle of the bin, but never beyond the samples actually seen
+    return std::min(std::max((b + 0.5f) * BIN_WIDTH, s.min), s.max);
+}
+
+bool Profiler::save(const std::string &fileName) const {
+    std::ofstream file(fileName);
+    if (!file) {
+        return false;
+    }
+    bool json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+    if (json) {
+        file << "{\n  \"sections\": [";
+    } else {
+        file << "section,gpu,samples,mean_ms,min_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    }
+    for (size_t i = 0; i < sections.size(); i++) {
+        const Section &s = sections[i];
+        double mean = s.count > 0 ? s.total / s.count : 0;
+        float min = s.count > 0 ? s.min : 0;
+        if (json) {
+            // the names are plain identifiers, chosen by the code: nothing to escape
+            file << (i > 0 ? "," : "") << "\n    {\"name\": \"" << s.name << "\", \"gpu\": " << (s.gpu ? "true" : "false")
+                 << ", \"samples\": " << s.count << ", \"mean_ms\": " << mean << ", \"min_ms\": " << min
+                 << ", \"p50_ms\": " << getPercentile(i, 0.5f) << ", \"p95_ms\": " << getPercentile(i, 0.95f)
+                 << ", \"p99_ms\": " << getPercentile(i, 0.99f) << ", \"max_ms\": " << s.max << "}";
+        } else {
+            file << s.name << "," << (s.gpu ? 1 : 0) << "," << s.count << "," << mean << "," << min << ","
+                 << getPercentile(i, 0.5f) << "," << getPercentile(i, 0.95f) << "," << getPercentile(i, 0.99f) << ","
+                 << s.max << "\n";
+        }
+    }
+    if (json) {
+        file << "\n  ]\n}\n";
+    }
+    return (bool)file;
+}
@@ -0,0 +1,72 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+
+// Timings of the parts of a frame, in milliseconds: measured on the CPU by ScopedTimer, on the GPU by
+// timestamp queries (see BaseProject::readTimestamps). Each section keeps its last samples, drawn as a
+// rolling histogram by the legend, and a histogram of all of them for the percentiles saved at exit.
+// Used by the render loop thread only.
+class Profiler {
+    public:
+        static const int HISTORY = 240;             // samples drawn by the legend
+        static constexpr float BIN_WIDTH = 0.01f;   // milliseconds, of the histogram of all the samples
+        static const int NUM_BINS = 10000;          // longer samples all fall in the last bin
+
+        struct Section {
+            std::string name;
+            bool gpu;
+            std::vector<float> history;             // circular, the oldest sample in slot next
+            int next;
+            long long count;
+            double total;
+            float min, max;
+            std::vector<unsigned int> bins;
+        };
+
+    private:
+        std::vector<Section> sections;
+        std::unordered_map<std::string, int> indices;
+
+        Profiler() {}
+
+    public:
+        static Profiler &getInstance();
+        Profiler(const Profiler &) = delete;
+        Profiler &operator=(const Profiler &) = delete;
+
+        // Index of the section, added the first time it is asked for
+        int getSection(const std::string &name, bool gpu = false);
+        void add(int section, float milliseconds);
+
+        const std::vector<Section> &getSections() const;
+        // of the samples still in the history
+        float getRecentMean(int section) const;
+        // p between 0 and 1, over all the samples
+        float getPercentile(int section, float p) const;
+
+        // Writes the statistics of every section: as JSON if fileName ends with .json, as CSV otherwise.
+        // Returns false if the file cannot be written.
+        bool save(const std::string &fileName) const;
+};
+
+// Adds the time until its destruction to a CPU section of the profiler
+class ScopedTimer {
+    private:
+        int section;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        ScopedTimer(const char *name) : section(Profiler::getInstance().getSection(name)), start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() {
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            Profiler::getInstance().add(section, elapsed.count());
+        }
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+#endif // PROFILER_HPP
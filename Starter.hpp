@@ -11,6 +11,11 @@
 #include <algorithm>
 #include <fstream>
 #include <array>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
@@ -37,6 +42,11 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "FrameExporter.hpp"
+#include "Profiler.hpp"
+#include "AllocationCounter.hpp"
+#include "ImageLoader.hpp"
+
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
@@ -51,6 +61,7 @@ const std::vector<const char*> validationLayers = {
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	std::optional<uint32_t> transferFamily;		// a family just for copies if any, else the graphics one
 
 	bool isComplete() {
 		return graphicsFamily.has_value() &&
@@ -137,6 +148,16 @@ void PrintVkError( VkResult result ) {
 
 class BaseProject;
 
+// A piece of one of the large device memory blocks of BaseProject (see BaseProject::allocateMemory)
+struct MemoryAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;		// where the resource is bound inside memory
+	void *mapped = nullptr;			// host visible memory is mapped as long as its block lives
+	uint32_t block = 0;
+	VkDeviceSize rangeOffset = 0;	// range taken from the block, alignment padding included
+	VkDeviceSize rangeSize = 0;
+};
+
 struct VertexBindingDescriptorElement {
 	uint32_t binding;
 	uint32_t stride;
@@ -188,9 +209,9 @@ enum ModelType {OBJ, GLTF};
 template <class Vert>
 class Model {
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	MemoryAllocation vertexBufferMemory;
 	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	MemoryAllocation indexBufferMemory;
 
 	public:
 	VertexDescriptor *VD;
@@ -212,13 +233,16 @@ struct Texture {
 	BaseProject *BP;
 	uint32_t mipLevels;
 	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
+	MemoryAllocation textureImageMemory;
 	VkImageView textureImageView;
 	VkSampler textureSampler;
 	int imgs;
 	static const int maxImgs = 6;
+	bool ready = true;					// false until a texture loaded with initAsync is copied
 	
 	void createTextureImage(const char *const files[], VkFormat Fmt);
+	void createTextureImageFromPixels(const unsigned char *const pixels[], int texWidth, int texHeight,
+									  int pixelSize, VkFormat Fmt);
 	void createTextureImageView(VkFormat Fmt);
 	void createTextureSampler(VkFilter magFilter,
 							 VkFilter minFilter,
@@ -231,7 +255,15 @@ struct Texture {
 							);
 
 	void init(BaseProject *bp, const char * file, VkFormat Fmt, bool initSampler);
+	// From pixels already in memory, of pixelSize bytes each in the format Fmt (e.g. a generated atlas)
+	void initPixels(BaseProject *bp, const unsigned char *pixels, int width, int height, int pixelSize, VkFormat Fmt);
 	void initCubic(BaseProject *bp, const char * files[6]);
+	// An array of layers images of width x height, to be filled later one layer at a time
+	// (see BaseProject::uploadImageLayer), sampled without repeating
+	void initArray(BaseProject *bp, int width, int height, int layers, VkFormat Fmt);
+	// As init, but the file is decoded by other threads and copied on the transfer queue while the frames
+	// go on: not to be drawn until ready (see BaseProject::onTextureReady)
+	void initAsync(BaseProject *bp, const char *file, VkFormat Fmt);
 	void cleanup();
 };
 
@@ -280,23 +312,36 @@ struct Pipeline {
 	void cleanup();
 };
 
-enum DescriptorSetElementType {UNIFORM, TEXTURE};
+// Read-only data for the shaders, too large for a uniform block. Either copied once in device local memory,
+// or (dynamic) kept host visible and mapped, to be rewritten while the GPU is not reading the same part
+struct StorageBuffer {
+	BaseProject *BP;
+	VkBuffer buffer;
+	MemoryAllocation bufferMemory;
+	VkDeviceSize size;
+	void *mapped;
+
+	void init(BaseProject *bp, VkDeviceSize size, const void *data, bool dynamic);
+	void write(VkDeviceSize offset, const void *src, VkDeviceSize size);
+	void cleanup();
+};
+
+enum DescriptorSetElementType {UNIFORM, TEXTURE, STORAGE};
 
 struct DescriptorSetElement {
 	int binding;
 	DescriptorSetElementType type;
 	int size;
 	Texture *tex;
+	StorageBuffer *buf;		// only for STORAGE
 };
 
 struct DescriptorSet {
 	BaseProject *BP;
 
-	std::vector<std::vector<VkBuffer>> uniformBuffers;
-	std::vector<std::vector<VkDeviceMemory>> uniformBuffersMemory;
+	// where each uniform (by slot) of each swap chain image is mapped, inside the uniform arena of BaseProject
+	std::vector<std::vector<void *>> uniformData;
 	std::vector<VkDescriptorSet> descriptorSets;
-	
-	std::vector<bool> toFree;
 
 	void init(BaseProject *bp, DescriptorSetLayout *L,
 		std::vector<DescriptorSetElement> E);
@@ -305,6 +350,22 @@ struct DescriptorSet {
   	void map(int currentImage, void *src, int size, int slot);
 };
 
+// Per-instance vertex data (one record for each drawn instance), rewritten every frame:
+// one buffer per swap chain image, kept mapped for its whole life
+struct InstanceBuffer {
+	BaseProject *BP;
+
+	std::vector<VkBuffer> buffers;
+	std::vector<MemoryAllocation> buffersMemory;
+	std::vector<void *> mapped;
+	VkDeviceSize size;
+
+	void init(BaseProject *bp, VkDeviceSize size);
+	void cleanup();
+  	void bind(VkCommandBuffer commandBuffer, uint32_t binding, int currentImage);
+  	void map(int currentImage, const void *src, VkDeviceSize size, VkDeviceSize offset = 0);
+};
+
 
 // MAIN ! 
 class BaseProject {
@@ -314,8 +375,11 @@ class BaseProject {
 	friend class Pipeline;
 	friend class DescriptorSetLayout;
 	friend class DescriptorSet;
+	friend class InstanceBuffer;
+	friend class StorageBuffer;
 public:
     GLFWwindow* window;
+	virtual ~BaseProject() {}
 	virtual void setWindowParameters() = 0;
     void run() {
     	windowResizable = GLFW_FALSE;
@@ -327,15 +391,140 @@ public:
         cleanup();
     }
 
+	// Renders without any window, surface or swap chain (e.g. on a server, with a software driver such as
+	// lavapipe): frames frames are drawn in offscreen images of width x height, the last one is saved
+	// in outputFile as a PNG
+	void runHeadless(uint32_t width, uint32_t height, int frames, std::string outputFile) {
+		headless = true;
+		window = nullptr;
+
+		setWindowParameters();
+		windowWidth = width;
+		windowHeight = height;
+		onWindowResize(width, height);
+		initVulkan();
+		for (int f = 0; f < frames; f++) {
+			drawFrame();
+		}
+		vkDeviceWaitIdle(device);
+		saveImage(lastImageIndex, outputFile);
+		cleanup();
+	}
+
+	// Renders frames frames without a window, advancing the animation by 1/fps seconds each, and saves them
+	// as PNG files named after filePattern (printf format of the frame number, e.g. "frame%05d.png").
+	// The frames are read back while the next ones are drawn and encoded on other threads.
+	void runExport(uint32_t width, uint32_t height, int frames, float fps, std::string filePattern) {
+		headless = true;
+		exporting = true;
+		window = nullptr;
+		headlessDeltaT = 1.0f / fps;
+
+		setWindowParameters();
+		windowWidth = width;
+		windowHeight = height;
+		onWindowResize(width, height);
+		FrameExporter frameExporter(filePattern, width, height);
+		exporter = &frameExporter;
+		initVulkan();
+		for (int f = 0; f < frames; f++) {
+			drawFrame();
+		}
+		vkDeviceWaitIdle(device);
+
+		// the last frames are still in their readback buffers
+		std::vector<std::pair<int, size_t>> last;
+		for (size_t i = 0; i < readbackFrames.size(); i++) {
+			if (readbackFrames[i] >= 0) {
+				last.push_back({readbackFrames[i], i});
+			}
+		}
+		std::sort(last.begin(), last.end());
+		for (const std::pair<int, size_t> &frame : last) {
+			exporter->add(frame.first, readbackBuffersMemory[frame.second].mapped);
+		}
+		exporter->finish();
+		exporter = nullptr;
+		cleanup();
+	}
+
+	// Renders frames frames without a window, as fast as possible, each one 1/60 s of animation after the
+	// previous one (see BarChart for the camera path), then prints the frame times and what reached the GPU
+	void runBenchmark(uint32_t width, uint32_t height, int frames) {
+		headless = true;
+		benchmarking = true;
+		window = nullptr;
+
+		setWindowParameters();
+		windowWidth = width;
+		windowHeight = height;
+		onWindowResize(width, height);
+		initVulkan();
+		// the data uploaded by the initialization is not part of the frames
+		frameCounters = {};
+		for (int f = 0; f < frames; f++) {
+			drawFrame();
+		}
+		vkDeviceWaitIdle(device);
+		printBenchmark();
+		cleanup();
+	}
+
+	// Records an indexed draw, counted for the benchmarks
+	void drawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount = 1, uint32_t firstIndex = 0) {
+		RecordedCounts *counts = recordedCounts(commandBuffer);
+		if (counts) {
+			counts->draws++;
+		}
+		vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, 0, 0);
+	}
+
 protected:
 	uint32_t windowWidth;
 	uint32_t windowHeight;
 	bool windowResizable;
 	std::string windowTitle;
 	VkClearColorValue initialBackgroundColor;
+	// Size of each descriptor pool: a new one is added when they run out
 	int uniformBlocksInPool;
 	int texturesInPool;
+	int storageBuffersInPool;
 	int setsInPool;
+	// Parts of the scene recorded separately (see populateCommandBuffer)
+	int numLayers = 1;
+	// No window: the swap chain images are replaced by offscreen ones (see runHeadless)
+	bool headless = false;
+	std::vector<MemoryAllocation> offscreenImagesMemory;
+	uint32_t lastImageIndex = 0;
+	float headlessDeltaT = 1.0f / 60.0f;
+
+	// Export of the frames (see runExport): each offscreen image is copied in its readback buffer
+	// by its command buffer, the copy is handed to the encoders when the image is drawn again
+	bool exporting = false;
+	FrameExporter *exporter = nullptr;
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<MemoryAllocation> readbackBuffersMemory;
+	std::vector<int> readbackFrames;		// frame held by each buffer, -1 if none
+	int exportedFrames = 0;
+
+	// What reaches the GPU, reported by runBenchmark. The draws and descriptor binds of each layer are
+	// counted while it is recorded, a frame then does those of the layers visible in it.
+	bool benchmarking = false;
+	struct RecordedCounts {
+		int draws;
+		int descriptorBinds;
+	};
+	std::vector<std::vector<RecordedCounts>> layerCounts;	// [layer][image]
+	struct FrameCounters {
+		uint64_t frames;
+		uint64_t uploadedBytes;		// staging copies, uniform blocks, instance and storage buffer writes
+		uint64_t draws;
+		uint64_t descriptorBinds;
+	} frameCounters = {};
+
+	// Debug builds check that a frame where nothing is recorded or uploaded makes no heap allocation
+	// on the render loop thread (see checkFrameAllocations)
+	int allocationWarnings = 0;
 
     VkInstance instance;
 
@@ -344,9 +533,43 @@ protected:
     VkDevice device;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
+	VkQueue transferQueue;						// the graphics queue if there is no other one for copies
+	uint32_t graphicsFamilyIndex;
+	uint32_t transferFamilyIndex;
 	VkCommandPool commandPool;
+	VkCommandPool transferCommandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
 
+	// Each layer is recorded in secondary command buffers (one per swap chain image), that the primary
+	// ones just execute: a changed layer is recorded again alone, and only for the images not in flight
+	std::vector<std::vector<VkCommandBuffer>> layerCommandBuffers;	// [layer][image]
+	std::vector<std::vector<bool>> layerDirty;						// [layer][image]
+	std::vector<bool> layerVisible;
+	std::vector<bool> primaryDirty;									// [image]
+
+	// Worker threads recording the layers. Worker t records the layers l with l % workers == t, allocated
+	// from its own recordingPools[t], so no pool is ever used by two threads at the same time.
+	std::vector<std::thread> recordingThreads;
+	std::vector<VkCommandPool> recordingPools;
+	std::vector<std::vector<std::pair<int, size_t>>> recordingJobs;	// [worker] (layer, image)
+	std::mutex recordingMutex;
+	std::condition_variable recordingStart;
+	std::condition_variable recordingDone;
+	uint64_t recordingGeneration = 0;
+	int recordingPending = 0;
+	bool recordingStop = false;
+	std::exception_ptr recordingError;
+
+	// GPU time of each layer, and of the whole frame: timestamps are written around them by their command
+	// buffers, in a query pool per swap chain image, and read when the image is drawn again (see readTimestamps)
+	bool timestampsSupported = false;
+	float timestampPeriod = 0;					// nanoseconds per tick
+	uint64_t timestampMask = 0;					// valid bits of the timestamps
+	std::vector<VkQueryPool> timestampPools;
+	std::vector<bool> timestampsWritten;		// [image] the pool holds the timestamps of a frame
+	std::vector<uint64_t> timestampResults;		// value and availability of each query
+	std::vector<int> gpuSections;				// profiler section of each layer, the whole frame last
+
     VkSwapchainKHR swapChain;
     std::vector<VkImage> swapChainImages;
 	VkFormat swapChainImageFormat;
@@ -355,17 +578,80 @@ protected:
 	
 	VkRenderPass renderPass;
 	
- 	VkDescriptorPool descriptorPool;
+ 	std::vector<VkDescriptorPool> descriptorPools;
+	uint32_t poolSetsLeft, poolUniformsLeft, poolTexturesLeft, poolStorageBuffersLeft;
+
+	// The uniform blocks of all the descriptor sets: few large buffers, mapped once, each with a region per
+	// swap chain image where the blocks are sub-allocated. Updating a uniform is then just a memcpy.
+	struct UniformArenaBlock {
+		VkBuffer buffer;
+		MemoryAllocation memory;
+		char *mapped;
+		VkDeviceSize regionSize;
+		VkDeviceSize used;
+	};
+	static constexpr VkDeviceSize UNIFORM_ARENA_REGION_SIZE = 64 * 1024;
+	std::vector<UniformArenaBlock> uniformArena;
+	VkDeviceSize uniformAlignment = 0;
+
+	// Device memory is taken in large blocks, where buffers and images are sub-allocated, so that the number
+	// of vkAllocateMemory calls stays far from maxMemoryAllocationCount. Buffers and images never share a block,
+	// which keeps them bufferImageGranularity apart.
+	struct MemoryBlock {
+		VkDeviceMemory memory;
+		uint32_t memoryTypeIndex;
+		bool linear;								// buffers (true) or images (false)
+		VkDeviceSize size;
+		void *mapped;
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;	// offset -> size, sorted to merge the neighbours
+		int allocations;
+	};
+	static constexpr VkDeviceSize MEMORY_BLOCK_SIZE = 32 * 1024 * 1024;
+	std::vector<MemoryBlock> memoryBlocks;
+
+	// Uploads recorded by uploadBuffer() and not yet submitted
+	VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+	std::vector<VkBuffer> uploadStagingBuffers;
+	std::vector<MemoryAllocation> uploadStagingBuffersMemory;
+	uint64_t submittedUploads = 0;		// submissions of flushUploads(), and asynchronous batches submitted or complete
+
+	// Images copied on the transfer queue while the frames go on (see uploadImageAsync): a batch per frame,
+	// whose fence tells when it is complete. The frame that first sees it complete waits for its semaphore
+	// as well, which makes the copies visible to its shaders.
+	struct AsyncUploadBatch {
+		uint64_t id;
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+		VkSemaphore semaphore;
+		std::vector<VkBuffer> stagingBuffers;
+		std::vector<MemoryAllocation> stagingBuffersMemory;
+	};
+	AsyncUploadBatch recordingAsyncUploads{0, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, {}, {}};
+	std::vector<AsyncUploadBatch> asyncUploads;				// submitted, in order
+	uint64_t submittedAsyncUploads = 0;
+	uint64_t completedAsyncUploads = 0;
+	std::vector<VkSemaphore> asyncUploadWaits;				// for the next frame to wait
+	std::vector<VkSemaphore> asyncUploadsRetired[MAX_FRAMES_IN_FLIGHT];	// waited by the frames in flight
+	std::vector<VkSemaphore> frameWaitSemaphores;
+	std::vector<VkPipelineStageFlags> frameWaitStages;
+
+	// The textures decoded by imageLoader, with the batch that copies each (0 while it is decoded)
+	struct AsyncTexture {
+		Texture *texture;
+		uint64_t batch;
+	};
+	std::vector<AsyncTexture> asyncTextures;
+	ImageLoader imageLoader;
 
 	VkDebugUtilsMessengerEXT debugMessenger;
 	
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	MemoryAllocation depthImageMemory;
 	VkImageView depthImageView;
 
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 	VkImage colorImage;
-	VkDeviceMemory colorImageMemory;
+	MemoryAllocation colorImageMemory;
 	VkImageView colorImageView;
 
 	std::vector<VkFramebuffer> swapChainFramebuffers;
@@ -413,12 +699,14 @@ protected:
 		createImageViews();				
 		createRenderPass();			
 		createCommandPool();			
+		setupTimestamps();
 		createColorResources();
 		createDepthResources();			
 		createFramebuffers();			
 		createDescriptorPool();			
 
 		localInit();
+		flushUploads();
 		pipelinesAndDescriptorSetsInit();
 
 		createCommandBuffers();			
@@ -478,9 +766,12 @@ std::cout << "Starting createInstance()\n"  << std::flush;
     
     std::vector<const char*> getRequiredExtensions() {
 		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions =
-			glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		const char** glfwExtensions = nullptr;
+		// nothing is presented without a window
+		if (!headless) {
+			glfwExtensions =
+				glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		}
 
 		std::vector<const char*> extensions(glfwExtensions,
 			glfwExtensions + glfwExtensionCount);
@@ -598,6 +889,10 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	}
 
     void createSurface() {
+		if (headless) {
+			surface = VK_NULL_HANDLE;
+			return;
+		}
     	if (glfwCreateWindowSurface(instance, window, nullptr, &surface)
     			!= VK_SUCCESS) {
 			throw std::runtime_error("failed to create window surface!");
@@ -639,6 +934,12 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		
 		std::vector<VkPhysicalDevice> devices(deviceCount);
 		vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+		if (headless) {
+			deviceExtensions.erase(std::remove_if(deviceExtensions.begin(), deviceExtensions.end(),
+					[](const char *ext) { return strcmp(ext, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; }),
+				deviceExtensions.end());
+		}
 		
 		std::cout << "Physical devices found: " << deviceCount << "\n";
 		
@@ -669,8 +970,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		devRep.extensionsSupported = checkDeviceExtensionSupport(device, devRep);
 
-		devRep.swapChainAdequate = false;
-		if (devRep.extensionsSupported) {
+		devRep.swapChainAdequate = headless;
+		if (devRep.extensionsSupported && !headless) {
 			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 			devRep.swapChainFormatSupport = swapChainSupport.formats.empty();
 			devRep.swapChainPresentModeSupport = swapChainSupport.presentModes.empty();
@@ -706,8 +1007,13 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			}
 				
 			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
-												 &presentSupport);
+			if (headless) {
+				// the "present" queue only has to wait for the drawing
+				presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			} else {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
+													 &presentSupport);
+			}
 			if (presentSupport) {
 			 	indices.presentFamily = i;
 			}
@@ -718,6 +1024,18 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			i++;
 		}
 
+		// the copies on a queue of their own run alongside the drawing
+		for (uint32_t f = 0; f < queueFamilyCount; f++) {
+			VkQueueFlags flags = queueFamilies[f].queueFlags;
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+				indices.transferFamily = f;
+				break;
+			}
+		}
+		if (!indices.transferFamily.has_value()) {
+			indices.transferFamily = indices.graphicsFamily;
+		}
+
 		return indices;
 	}
 
@@ -793,7 +1111,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies =
-				{indices.graphicsFamily.value(), indices.presentFamily.value()};
+				{indices.graphicsFamily.value(), indices.presentFamily.value(),
+				 indices.transferFamily.value()};
 		
 		float queuePriority = 1.0f;
 		for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -835,9 +1154,16 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+		vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+		graphicsFamilyIndex = indices.graphicsFamily.value();
+		transferFamilyIndex = indices.transferFamily.value();
 	}
 	
 	void createSwapChain() {
+		if (headless) {
+			createOffscreenImages();
+			return;
+		}
 		SwapChainSupportDetails swapChainSupport =
 				querySwapChainSupport(physicalDevice);
 		VkSurfaceFormatKHR surfaceFormat =
@@ -897,6 +1223,75 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		swapChainExtent = extent;
 	}
 
+	// Stand-ins for the swap chain images when there is no window: one per frame in flight,
+	// left in TRANSFER_SRC_OPTIMAL by the render pass so they can be read back
+	void createOffscreenImages() {
+		swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+		swapChainExtent = {windowWidth, windowHeight};
+		swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+		offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			createImage(windowWidth, windowHeight, 1, 1, VK_SAMPLE_COUNT_1_BIT,
+						swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						swapChainImages[i], offscreenImagesMemory[i]);
+		}
+
+		if (exporting) {
+			VkDeviceSize size = (VkDeviceSize)windowWidth * windowHeight * 4;
+			readbackBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+			readbackBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+			readbackFrames.assign(MAX_FRAMES_IN_FLIGHT, -1);
+			for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+				createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+							 readbackBuffers[i], readbackBuffersMemory[i]);
+			}
+		}
+	}
+
+	// Copies offscreen image i (after its render pass) in a host visible buffer, to be read once complete
+	void recordReadback(VkCommandBuffer commandBuffer, uint32_t i, VkBuffer buffer) {
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+		vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+							   buffer, 1, &region);
+
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+							 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Writes a rendered offscreen image in a PNG file
+	void saveImage(uint32_t i, std::string fileName) {
+		VkDeviceSize size = (VkDeviceSize)swapChainExtent.width * swapChainExtent.height * 4;
+		VkBuffer readbackBuffer;
+		MemoryAllocation readbackBufferMemory;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 readbackBuffer, readbackBufferMemory);
+
+		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		recordReadback(commandBuffer, i, readbackBuffer);
+		endSingleTimeCommands(commandBuffer);
+
+		int written = stbi_write_png(fileName.c_str(), swapChainExtent.width, swapChainExtent.height, 4,
+									 readbackBufferMemory.mapped, swapChainExtent.width * 4);
+		vkDestroyBuffer(device, readbackBuffer, nullptr);
+		freeMemory(readbackBufferMemory);
+		if (!written) {
+			throw std::runtime_error("failed to write " + fileName + "!");
+		}
+	}
+
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(
 				const std::vector<VkSurfaceFormatKHR>& availableFormats)
 	{
@@ -984,7 +1379,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachmentResolve.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL :
+												VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 		VkAttachmentReference colorAttachmentResolveRef{};
 		colorAttachmentResolveRef.attachment = 2;
@@ -1094,13 +1490,175 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		poolInfo.flags = 0; // Optional
+		// the layers are recorded again when they change
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		
 		VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
 		if (result != VK_SUCCESS) {
 		 	PrintVkError(result);
 			throw std::runtime_error("failed to create command pool!");
 		}
+
+		// one worker per layer at most, leaving a core to the main thread
+		int workers = std::max(1, std::min(numLayers, (int)std::thread::hardware_concurrency() - 1));
+		recordingPools.resize(workers);
+		recordingJobs.resize(workers);
+		for (int t = 0; t < workers; t++) {
+			result = vkCreateCommandPool(device, &poolInfo, nullptr, &recordingPools[t]);
+			if (result != VK_SUCCESS) {
+			 	PrintVkError(result);
+				throw std::runtime_error("failed to create command pool!");
+			}
+		}
+		for (int t = 0; t < workers; t++) {
+			recordingThreads.push_back(std::thread(&BaseProject::recordingLoop, this, t));
+		}
+
+		// a command buffer per batch of asynchronous uploads, freed once it is complete
+		VkCommandPoolCreateInfo transferPoolInfo{};
+		transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		transferPoolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
+		transferPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		result = vkCreateCommandPool(device, &transferPoolInfo, nullptr, &transferCommandPool);
+		if (result != VK_SUCCESS) {
+		 	PrintVkError(result);
+			throw std::runtime_error("failed to create command pool!");
+		}
+	}
+
+	void setupTimestamps() {
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+		uint32_t validBits = queueFamilies[queueFamilyIndices.graphicsFamily.value()].timestampValidBits;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		timestampsSupported = validBits > 0 && properties.limits.timestampPeriod > 0;
+		if (!timestampsSupported) {
+			std::cout << "No GPU timestamps on this device: only the CPU times are profiled\n";
+			return;
+		}
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+
+		Profiler &profiler = Profiler::getInstance();
+		gpuSections.clear();
+		for (int l = 0; l < numLayers; l++) {
+			gpuSections.push_back(profiler.getSection("gpu " + getLayerName(l), true));
+		}
+		gpuSections.push_back(profiler.getSection("gpu frame", true));
+	}
+
+	// Two queries per layer and two for the whole frame, begin and end
+	void createTimestampPools() {
+		if (!timestampsSupported) {
+			return;
+		}
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = 2 * numLayers + 2;
+
+		timestampPools.resize(swapChainImages.size());
+		timestampsWritten.assign(swapChainImages.size(), false);
+		timestampResults.resize(2 * poolInfo.queryCount);
+		for (size_t i = 0; i < timestampPools.size(); i++) {
+			VkResult result = vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPools[i]);
+			if (result != VK_SUCCESS) {
+			 	PrintVkError(result);
+				throw std::runtime_error("failed to create query pool!");
+			}
+		}
+	}
+
+	void destroyTimestampPools() {
+		for (VkQueryPool pool : timestampPools) {
+			vkDestroyQueryPool(device, pool, nullptr);
+		}
+		timestampPools.clear();
+	}
+
+	// Adds to the profiler the GPU times of the last frame drawn in image i: to be called once it is complete.
+	// The layers hidden in that frame have no timestamps and are skipped.
+	void readTimestamps(uint32_t i) {
+		if (timestampPools.empty() || !timestampsWritten[i]) {
+			return;
+		}
+		VkResult result = vkGetQueryPoolResults(device, timestampPools[i], 0,
+				static_cast<uint32_t>(timestampResults.size() / 2),
+				timestampResults.size() * sizeof(uint64_t), timestampResults.data(), 2 * sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result != VK_SUCCESS && result != VK_NOT_READY) {
+		 	PrintVkError(result);
+			throw std::runtime_error("failed to get query pool results!");
+		}
+		Profiler &profiler = Profiler::getInstance();
+		for (int q = 0; q <= numLayers; q++) {
+			const uint64_t *begin = &timestampResults[4 * q];
+			const uint64_t *end = &timestampResults[4 * q + 2];
+			if (begin[1] != 0 && end[1] != 0) {
+				uint64_t ticks = (end[0] - begin[0]) & timestampMask;
+				profiler.add(gpuSections[q], ticks * timestampPeriod / 1e6f);
+			}
+		}
+		timestampsWritten[i] = false;
+	}
+
+	// Name of a layer, in the profiler sections
+	virtual std::string getLayerName(int layer) {
+		return "layer " + std::to_string(layer);
+	}
+
+	void destroyRecordingWorkers() {
+		{
+			std::lock_guard<std::mutex> lock(recordingMutex);
+			recordingStop = true;
+		}
+		recordingStart.notify_all();
+		for (std::thread &thread : recordingThreads) {
+			thread.join();
+		}
+		recordingThreads.clear();
+		for (VkCommandPool pool : recordingPools) {
+			vkDestroyCommandPool(device, pool, nullptr);
+		}
+		recordingPools.clear();
+	}
+
+	void recordingLoop(int t) {
+		uint64_t generation = 0;
+		for (;;) {
+			std::vector<std::pair<int, size_t>> jobs;
+			{
+				std::unique_lock<std::mutex> lock(recordingMutex);
+				recordingStart.wait(lock, [&] { return recordingStop || recordingGeneration != generation; });
+				if (recordingStop) {
+					return;
+				}
+				generation = recordingGeneration;
+				jobs.swap(recordingJobs[t]);
+			}
+			std::exception_ptr error;
+			try {
+				for (const std::pair<int, size_t> &job : jobs) {
+					recordLayer(job.first, job.second);
+				}
+			} catch (...) {
+				error = std::current_exception();
+			}
+			{
+				std::lock_guard<std::mutex> lock(recordingMutex);
+				if (error) {
+					recordingError = error;
+				}
+				if (--recordingPending == 0) {
+					recordingDone.notify_one();
+				}
+			}
+		}
 	}
 
 	void createColorResources() {
@@ -1170,7 +1728,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 				 	 VkImageTiling tiling, VkImageUsageFlags usage,
 				 	 VkImageCreateFlags cflags,
 				 	 VkMemoryPropertyFlags properties, VkImage& image,
-				 	 VkDeviceMemory& imageMemory) {		
+				 	 MemoryAllocation& imageMemory, bool transferShared = false) {		
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1184,6 +1742,14 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageInfo.usage = usage;
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		// written by the transfer queue (see uploadImageAsync) and read by the graphics one, without
+		// handing it over between them
+		uint32_t families[] = {graphicsFamilyIndex, transferFamilyIndex};
+		if (transferShared && graphicsFamilyIndex != transferFamilyIndex) {
+			imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			imageInfo.queueFamilyIndexCount = 2;
+			imageInfo.pQueueFamilyIndices = families;
+		}
 		imageInfo.samples = numSamples;
 		imageInfo.flags = cflags; 
 		
@@ -1196,17 +1762,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-											properties);
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) !=
-								VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate image memory!");
-		}
-
-		vkBindImageMemory(device, image, imageMemory, 0);
+		imageMemory = allocateMemory(memRequirements, properties, false);
+		vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 	}
 
 	void generateMipmaps(VkImage image, VkFormat imageFormat,
@@ -1222,14 +1779,22 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		}
 
 		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-		
+		recordMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels, 0, layerCount);
+		endSingleTimeCommands(commandBuffer);
+	}
+
+	// Fills the mip levels of layerCount layers from their level 0, in TRANSFER_DST layout, and leaves them
+	// all ready for the shaders
+	void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image,
+					   int32_t texWidth, int32_t texHeight,
+					   uint32_t mipLevels, int baseLayer, int layerCount) {
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 		barrier.image = image;
 		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.baseArrayLayer = baseLayer;
 		barrier.subresourceRange.layerCount = layerCount;
 		barrier.subresourceRange.levelCount = 1;
 
@@ -1254,14 +1819,14 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
 			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			blit.srcSubresource.mipLevel = i - 1;
-			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.baseArrayLayer = baseLayer;
 			blit.srcSubresource.layerCount = layerCount;
 			blit.dstOffsets[0] = { 0, 0, 0 };
 			blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1,
 								   mipHeight > 1 ? mipHeight/2:1, 1};
 			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 			blit.dstSubresource.mipLevel = i;
-			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.baseArrayLayer = baseLayer;
 			blit.dstSubresource.layerCount = layerCount;
 			
 			vkCmdBlitImage(commandBuffer, image,
@@ -1293,8 +1858,6 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 							 0, nullptr, 0, nullptr,
 							 1, &barrier);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 	
 	void transitionImageLayout(VkImage image, VkFormat format,
@@ -1378,6 +1941,309 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		endSingleTimeCommands(commandBuffer);
 	}
 	
+	// Copies data in a device local buffer through a staging buffer. The copy is only recorded:
+	// all the uploads are submitted together, waiting once, by flushUploads()
+	void uploadBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer) {
+		VkBuffer stagingBuffer;
+		MemoryAllocation stagingBufferMemory;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 stagingBuffer, stagingBufferMemory);
+		memcpy(stagingBufferMemory.mapped, data, (size_t) size);
+		frameCounters.uploadedBytes += size;
+
+		if(uploadCommandBuffer == VK_NULL_HANDLE) {
+			uploadCommandBuffer = beginSingleTimeCommands();
+		}
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = 0;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(uploadCommandBuffer, stagingBuffer, dstBuffer, 1, &copyRegion);
+
+		uploadStagingBuffers.push_back(stagingBuffer);
+		uploadStagingBuffersMemory.push_back(stagingBufferMemory);
+	}
+
+	// Replaces the layer-th layer of a sampled image array (pixels: its level 0, the other mip levels are
+	// generated from it), recorded with the other uploads. The frames already submitted may still read the
+	// old content: the copy waits for their fragment shaders.
+	void uploadImageLayer(const void *pixels, VkDeviceSize size, VkImage image,
+						  uint32_t width, uint32_t height, uint32_t mipLevels, int layer) {
+		VkBuffer stagingBuffer;
+		MemoryAllocation stagingBufferMemory;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 stagingBuffer, stagingBufferMemory);
+		memcpy(stagingBufferMemory.mapped, pixels, (size_t) size);
+		frameCounters.uploadedBytes += size;
+
+		if(uploadCommandBuffer == VK_NULL_HANDLE) {
+			uploadCommandBuffer = beginSingleTimeCommands();
+		}
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = layer;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(uploadCommandBuffer,
+							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+							 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = layer;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = {0, 0, 0};
+		region.imageExtent = {width, height, 1};
+		vkCmdCopyBufferToImage(uploadCommandBuffer, stagingBuffer, image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		recordMipmaps(uploadCommandBuffer, image, width, height, mipLevels, layer, 1);
+
+		uploadStagingBuffers.push_back(stagingBuffer);
+		uploadStagingBuffersMemory.push_back(stagingBufferMemory);
+	}
+
+	void flushUploads() {
+		if(uploadCommandBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+
+		// the copies must be complete before the buffers are read by the shaders
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+								VK_ACCESS_INDEX_READ_BIT |
+								VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(uploadCommandBuffer,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+							 VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+							 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+							 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		endSingleTimeCommands(uploadCommandBuffer);
+		uploadCommandBuffer = VK_NULL_HANDLE;
+		submittedUploads++;
+
+		for (size_t i = 0; i < uploadStagingBuffers.size(); i++) {
+			vkDestroyBuffer(device, uploadStagingBuffers[i], nullptr);
+			freeMemory(uploadStagingBuffersMemory[i]);
+		}
+		uploadStagingBuffers.clear();
+		uploadStagingBuffersMemory.clear();
+	}
+
+	// Copies a layer of an image, with all its mip levels (chain: see buildMipChain), on the transfer queue,
+	// without waiting for it: the copy is submitted with the frame, and complete when isUploadComplete
+	// says so, until then the layer must not be drawn. Returns the id of its batch.
+	// The previous content must not be read anymore by the frames in flight: the transfer queue cannot wait
+	// for their shaders.
+	uint64_t uploadImageAsync(const unsigned char *chain, VkImage image, VkImageLayout oldLayout,
+							  uint32_t width, uint32_t height, uint32_t mipLevels, int layer) {
+		VkDeviceSize size = mipLevelOffset(width, height, mipLevels);
+		VkBuffer stagingBuffer;
+		MemoryAllocation stagingBufferMemory;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 stagingBuffer, stagingBufferMemory);
+		memcpy(stagingBufferMemory.mapped, chain, (size_t) size);
+		frameCounters.uploadedBytes += size;
+
+		AsyncUploadBatch &batch = recordingAsyncUploads;
+		if (batch.commandBuffer == VK_NULL_HANDLE) {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = transferCommandPool;
+			allocInfo.commandBufferCount = 1;
+			vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer);
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+			batch.id = submittedAsyncUploads + 1;
+		}
+
+		// after the copies of the previous batches, which may have written the same layer
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = mipLevels;
+		barrier.subresourceRange.baseArrayLayer = layer;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(batch.commandBuffer,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+							 0, nullptr, 0, nullptr, 1, &barrier);
+
+		// the mip levels are copied as they are: a transfer queue cannot blit
+		VkBufferImageCopy regions[32];
+		for (uint32_t l = 0; l < mipLevels; l++) {
+			regions[l] = VkBufferImageCopy{};
+			regions[l].bufferOffset = mipLevelOffset(width, height, l);
+			regions[l].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			regions[l].imageSubresource.mipLevel = l;
+			regions[l].imageSubresource.baseArrayLayer = layer;
+			regions[l].imageSubresource.layerCount = 1;
+			regions[l].imageOffset = {0, 0, 0};
+			regions[l].imageExtent = {std::max(width >> l, 1u), std::max(height >> l, 1u), 1};
+		}
+		vkCmdCopyBufferToImage(batch.commandBuffer, stagingBuffer, image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(batch.commandBuffer,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+							 0, nullptr, 0, nullptr, 1, &barrier);
+
+		batch.stagingBuffers.push_back(stagingBuffer);
+		batch.stagingBuffersMemory.push_back(stagingBufferMemory);
+		return batch.id;
+	}
+
+	// Submits the uploads recorded by uploadImageAsync since the last call
+	void submitAsyncUploads() {
+		AsyncUploadBatch &batch = recordingAsyncUploads;
+		if (batch.commandBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+		vkEndCommandBuffer(batch.commandBuffer);
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create synchronization objects for an upload!");
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch.commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &batch.semaphore;
+		if (vkQueueSubmit(transferQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit upload command buffer!");
+		}
+
+		asyncUploads.push_back(std::move(batch));
+		batch = AsyncUploadBatch{0, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, {}, {}};
+		submittedAsyncUploads++;
+		submittedUploads++;
+	}
+
+	bool isUploadComplete(uint64_t id) {
+		return id <= completedAsyncUploads;
+	}
+
+	// Once per frame, before it is recorded: the batches complete since the last call are released (their
+	// semaphores left to the frame), the textures they copied are ready, and the images decoded meanwhile
+	// are recorded in the next batch
+	void pollAsyncUploads() {
+		size_t done = 0;
+		while (done < asyncUploads.size() &&
+			   vkGetFenceStatus(device, asyncUploads[done].fence) == VK_SUCCESS) {
+			AsyncUploadBatch &batch = asyncUploads[done++];
+			for (size_t i = 0; i < batch.stagingBuffers.size(); i++) {
+				vkDestroyBuffer(device, batch.stagingBuffers[i], nullptr);
+				freeMemory(batch.stagingBuffersMemory[i]);
+			}
+			vkFreeCommandBuffers(device, transferCommandPool, 1, &batch.commandBuffer);
+			vkDestroyFence(device, batch.fence, nullptr);
+			asyncUploadWaits.push_back(batch.semaphore);
+			completedAsyncUploads = batch.id;
+			submittedUploads++;
+		}
+		asyncUploads.erase(asyncUploads.begin(), asyncUploads.begin() + done);
+
+		for (AsyncTexture &t : asyncTextures) {
+			if (!t.texture->ready && t.batch != 0 && isUploadComplete(t.batch)) {
+				t.texture->ready = true;
+				onTextureReady(t.texture);
+			}
+		}
+
+		ImageLoader::Image image;
+		while (imageLoader.take(image)) {
+			Texture *texture = asyncTextures[image.id].texture;
+			if (!image.pixels) {
+				throw std::runtime_error("failed to load texture image!");
+			}
+			asyncTextures[image.id].batch = uploadImageAsync(image.pixels, texture->textureImage,
+					VK_IMAGE_LAYOUT_UNDEFINED, image.width, image.height, texture->mipLevels, 0);
+			ImageLoader::freePixels(image.pixels);
+		}
+	}
+
+	// Waits for every asynchronous upload asked for, as the headless runs do to draw each frame complete
+	void finishAsyncUploads() {
+		imageLoader.waitIdle();
+		pollAsyncUploads();
+		submitAsyncUploads();
+		vkQueueWaitIdle(transferQueue);
+		pollAsyncUploads();
+	}
+
+	void releaseAsyncUploads() {
+		for (AsyncUploadBatch &batch : asyncUploads) {
+			for (size_t i = 0; i < batch.stagingBuffers.size(); i++) {
+				vkDestroyBuffer(device, batch.stagingBuffers[i], nullptr);
+				freeMemory(batch.stagingBuffersMemory[i]);
+			}
+			vkDestroyFence(device, batch.fence, nullptr);
+			vkDestroySemaphore(device, batch.semaphore, nullptr);
+		}
+		asyncUploads.clear();
+		AsyncUploadBatch &batch = recordingAsyncUploads;
+		for (size_t i = 0; i < batch.stagingBuffers.size(); i++) {
+			vkDestroyBuffer(device, batch.stagingBuffers[i], nullptr);
+			freeMemory(batch.stagingBuffersMemory[i]);
+		}
+		batch.stagingBuffers.clear();
+		batch.stagingBuffersMemory.clear();
+		for (VkSemaphore s : asyncUploadWaits) {
+			vkDestroySemaphore(device, s, nullptr);
+		}
+		asyncUploadWaits.clear();
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			for (VkSemaphore s : asyncUploadsRetired[i]) {
+				vkDestroySemaphore(device, s, nullptr);
+			}
+			asyncUploadsRetired[i].clear();
+		}
+	}
+
 	VkCommandBuffer beginSingleTimeCommands() { 
 		VkCommandBufferAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1412,7 +2278,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 					  VkMemoryPropertyFlags properties,
-					  VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+					  VkBuffer& buffer, MemoryAllocation& bufferMemory) {
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = size;
@@ -1429,27 +2295,196 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 		
+		bufferMemory = allocateMemory(memRequirements, properties, true);
+		vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);	
+	}
+
+	// First fit in the blocks of the right memory type, a new block when none has room.
+	// Resources larger than a block get a block of their own.
+	MemoryAllocation allocateMemory(const VkMemoryRequirements &memRequirements,
+									VkMemoryPropertyFlags properties, bool linear) {
+		uint32_t memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+		VkDeviceSize alignment = std::max(memRequirements.alignment, (VkDeviceSize)1);
+
+		for (uint32_t b = 0; b < memoryBlocks.size(); b++) {
+			MemoryBlock &block = memoryBlocks[b];
+			if (block.memory == VK_NULL_HANDLE || block.memoryTypeIndex != memoryTypeIndex ||
+				block.linear != linear) {
+				continue;
+			}
+			for (auto &range : block.freeRanges) {
+				VkDeviceSize offset = (range.first + alignment - 1) / alignment * alignment;
+				if (offset + memRequirements.size <= range.first + range.second) {
+					return takeRange(b, range.first, offset, memRequirements.size);
+				}
+			}
+		}
+
+		MemoryBlock block{};
+		block.memoryTypeIndex = memoryTypeIndex;
+		block.linear = linear;
+		block.size = std::max(MEMORY_BLOCK_SIZE, memRequirements.size);
+		block.mapped = nullptr;
+		block.allocations = 0;
+
 		VkMemoryAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex =
-				findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		result = vkAllocateMemory(device, &allocInfo, nullptr,
-				&bufferMemory);
+		allocInfo.allocationSize = block.size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+		VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &block.memory);
 		if (result != VK_SUCCESS) {
 		 	PrintVkError(result);
-			throw std::runtime_error("failed to allocate vertex buffer memory!");
+			throw std::runtime_error("failed to allocate device memory!");
 		}
-		
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);	
-	}
-	
-	uint32_t findMemoryType(uint32_t typeFilter,
-							VkMemoryPropertyFlags properties) {
-		 VkPhysicalDeviceMemoryProperties memProperties;
-		 vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-		 
+
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			result = vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+			if (result != VK_SUCCESS) {
+			 	PrintVkError(result);
+				throw std::runtime_error("failed to map device memory!");
+			}
+		}
+		block.freeRanges[0] = block.size;
+
+		// reuse the place of a released block, if any
+		uint32_t b = 0;
+		while (b < memoryBlocks.size() && memoryBlocks[b].memory != VK_NULL_HANDLE) {
+			b++;
+		}
+		if (b == memoryBlocks.size()) {
+			memoryBlocks.push_back(block);
+		} else {
+			memoryBlocks[b] = block;
+		}
+		return takeRange(b, 0, 0, memRequirements.size);
+	}
+
+	MemoryAllocation takeRange(uint32_t b, VkDeviceSize rangeOffset, VkDeviceSize offset, VkDeviceSize size) {
+		MemoryBlock &block = memoryBlocks[b];
+		VkDeviceSize rangeSize = block.freeRanges[rangeOffset];
+		block.freeRanges.erase(rangeOffset);
+		if (offset + size < rangeOffset + rangeSize) {
+			block.freeRanges[offset + size] = rangeOffset + rangeSize - (offset + size);
+		}
+		block.allocations++;
+
+		MemoryAllocation allocation;
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.mapped = block.mapped ? static_cast<char *>(block.mapped) + offset : nullptr;
+		allocation.block = b;
+		allocation.rangeOffset = rangeOffset;
+		allocation.rangeSize = offset + size - rangeOffset;
+		return allocation;
+	}
+
+	void freeMemory(MemoryAllocation &allocation) {
+		if (allocation.memory == VK_NULL_HANDLE) {
+			return;
+		}
+		MemoryBlock &block = memoryBlocks[allocation.block];
+		VkDeviceSize offset = allocation.rangeOffset;
+		VkDeviceSize size = allocation.rangeSize;
+
+		auto next = block.freeRanges.lower_bound(offset);
+		if (next != block.freeRanges.end() && offset + size == next->first) {
+			size += next->second;
+			next = block.freeRanges.erase(next);
+		}
+		if (next != block.freeRanges.begin()) {
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset) {
+				offset = previous->first;
+				size += previous->second;
+				block.freeRanges.erase(previous);
+			}
+		}
+		block.freeRanges[offset] = size;
+		block.allocations--;
+		allocation = MemoryAllocation();
+
+		// the regular blocks are kept for the next resources (e.g. after a swap chain recreation),
+		// the ones made for a single large resource are given back
+		if (block.allocations == 0 && block.size > MEMORY_BLOCK_SIZE) {
+			if (block.mapped) {
+				vkUnmapMemory(device, block.memory);
+			}
+			vkFreeMemory(device, block.memory, nullptr);
+			block.memory = VK_NULL_HANDLE;
+		}
+	}
+
+	void destroyMemoryBlocks() {
+		for (MemoryBlock &block : memoryBlocks) {
+			if (block.memory == VK_NULL_HANDLE) {
+				continue;
+			}
+			if (block.mapped) {
+				vkUnmapMemory(device, block.memory);
+			}
+			vkFreeMemory(device, block.memory, nullptr);
+		}
+		memoryBlocks.clear();
+	}
+
+	// Live allocations and fragmentation of every block: the free space that is not in its largest
+	// free range cannot hold a resource as large as that range
+	void printMemoryStats() {
+		VkDeviceSize totalSize = 0, totalUsed = 0;
+		int totalAllocations = 0;
+		std::cout << "Device memory blocks:\n";
+		for (size_t b = 0; b < memoryBlocks.size(); b++) {
+			const MemoryBlock &block = memoryBlocks[b];
+			if (block.memory == VK_NULL_HANDLE) {
+				continue;
+			}
+			VkDeviceSize freeSize = 0, largestFree = 0;
+			for (const auto &range : block.freeRanges) {
+				freeSize += range.second;
+				largestFree = std::max(largestFree, range.second);
+			}
+			float fragmentation = freeSize > 0 ? 1.0f - (float)largestFree / freeSize : 0.0f;
+			std::cout << "  block " << b << (block.linear ? " (buffers)" : " (images)")
+					  << ", memory type " << block.memoryTypeIndex
+					  << ": " << block.allocations << " allocations, "
+					  << (block.size - freeSize) << " / " << block.size << " bytes used, "
+					  << block.freeRanges.size() << " free ranges, largest " << largestFree
+					  << " bytes, fragmentation " << fragmentation * 100.0f << "%\n";
+			totalSize += block.size;
+			totalUsed += block.size - freeSize;
+			totalAllocations += block.allocations;
+		}
+		std::cout << "Total: " << totalAllocations << " allocations, " << totalUsed << " / "
+				  << totalSize << " bytes used\n" << std::flush;
+	}
+	
+	// The size of the largest heap with memory of these properties
+	VkDeviceSize memoryHeapSize(VkMemoryPropertyFlags properties) {
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		VkDeviceSize heapSize = 0;
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			if ((memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				heapSize = std::max(heapSize, memProperties.memoryHeaps[memProperties.memoryTypes[i].heapIndex].size);
+			}
+		}
+		return heapSize;
+	}
+
+	// The largest storage buffer that can be bound whole, in memory with these properties
+	VkDeviceSize maxStorageBufferSize(VkMemoryPropertyFlags properties) {
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		return std::min((VkDeviceSize)deviceProperties.limits.maxStorageBufferRange, memoryHeapSize(properties));
+	}
+
+	uint32_t findMemoryType(uint32_t typeFilter,
+							VkMemoryPropertyFlags properties) {
+		 VkPhysicalDeviceMemoryProperties memProperties;
+		 vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		 
 		 for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
 		 	if ((typeFilter & (1 << i)) && 
 		 		(memProperties.memoryTypes[i].propertyFlags & properties) ==
@@ -1461,30 +2496,102 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		throw std::runtime_error("failed to find suitable memory type!");
 	}
     
-	void createDescriptorPool() {
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	void createDescriptorPool(uint32_t minSets = 0, uint32_t minUniforms = 0, uint32_t minTextures = 0,
+							  uint32_t minStorageBuffers = 0) {
+		uint32_t sets = std::max(minSets, static_cast<uint32_t>(setsInPool * swapChainImages.size()));
+		uint32_t uniforms = std::max(minUniforms, static_cast<uint32_t>(uniformBlocksInPool * swapChainImages.size()));
+		uint32_t textures = std::max(minTextures, static_cast<uint32_t>(texturesInPool * swapChainImages.size()));
+		uint32_t storageBuffers = std::max(minStorageBuffers, static_cast<uint32_t>(storageBuffersInPool * swapChainImages.size()));
+
+		std::array<VkDescriptorPoolSize, 3> poolSizes{};
 		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(uniformBlocksInPool *
-															 swapChainImages.size());
+		poolSizes[0].descriptorCount = std::max(uniforms, 1u);
 		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(texturesInPool *
-															 swapChainImages.size());
+		poolSizes[1].descriptorCount = std::max(textures, 1u);
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[2].descriptorCount = std::max(storageBuffers, 1u);
 															 
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());;
 		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(setsInPool * swapChainImages.size());
+		poolInfo.maxSets = std::max(sets, 1u);
 		
+		VkDescriptorPool descriptorPool;
 		VkResult result = vkCreateDescriptorPool(device, &poolInfo, nullptr,
 									&descriptorPool);
 		if (result != VK_SUCCESS) {
 		 	PrintVkError(result);
 			throw std::runtime_error("failed to create descriptor pool!");
 		}
+		descriptorPools.push_back(descriptorPool);
+		poolSetsLeft = sets;
+		poolUniformsLeft = uniforms;
+		poolTexturesLeft = textures;
+		poolStorageBuffersLeft = storageBuffers;
+	}
+
+	// Returns a pool with room for the given descriptors, adding a new one if the current pool is full
+	VkDescriptorPool reserveDescriptors(uint32_t sets, uint32_t uniforms, uint32_t textures, uint32_t storageBuffers) {
+		if (descriptorPools.empty() || sets > poolSetsLeft || uniforms > poolUniformsLeft ||
+			textures > poolTexturesLeft || storageBuffers > poolStorageBuffersLeft) {
+			createDescriptorPool(sets, uniforms, textures, storageBuffers);
+		}
+		poolSetsLeft -= sets;
+		poolUniformsLeft -= uniforms;
+		poolTexturesLeft -= textures;
+		poolStorageBuffersLeft -= storageBuffers;
+		return descriptorPools.back();
+	}
+
+	void destroyDescriptorPools() {
+		for (VkDescriptorPool descriptorPool : descriptorPools) {
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		}
+		descriptorPools.clear();
+	}
+
+	void addUniformArenaBlock(VkDeviceSize regionSize) {
+		if (uniformAlignment == 0) {
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			uniformAlignment = std::max(properties.limits.minUniformBufferOffsetAlignment, (VkDeviceSize)16);
+		}
+
+		UniformArenaBlock block{};
+		block.regionSize = (regionSize + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+		block.used = 0;
+		createBuffer(block.regionSize * swapChainImages.size(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 block.buffer, block.memory);
+		block.mapped = static_cast<char *>(block.memory.mapped);
+		uniformArena.push_back(block);
+	}
+
+	// Reserves size bytes in the region of every swap chain image of a block of the arena.
+	// The data of image i is at regionSize * i + offset in that block.
+	void allocateUniform(VkDeviceSize size, uint32_t &blockIndex, VkDeviceSize &offset) {
+		if (uniformArena.empty() || uniformArena.back().regionSize <
+			(uniformArena.back().used + uniformAlignment - 1) / uniformAlignment * uniformAlignment + size) {
+			addUniformArenaBlock(std::max(UNIFORM_ARENA_REGION_SIZE, size));
+		}
+		UniformArenaBlock &block = uniformArena.back();
+		offset = (block.used + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+		block.used = offset + size;
+		blockIndex = static_cast<uint32_t>(uniformArena.size() - 1);
+	}
+
+	void destroyUniformArena() {
+		for (UniformArenaBlock &block : uniformArena) {
+			vkDestroyBuffer(device, block.buffer, nullptr);
+			freeMemory(block.memory);
+		}
+		uniformArena.clear();
 	}
 	
-	virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int i) = 0;
+	// Records the draw commands of one layer, inside the render pass
+	virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, int layer) = 0;
 
     void createCommandBuffers() {
     	commandBuffers.resize(swapChainFramebuffers.size());
@@ -1501,46 +2608,245 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		 	PrintVkError(result);
 			throw std::runtime_error("failed to allocate command buffers!");
 		}
+
+		createTimestampPools();
+
+		layerCounts.assign(numLayers, std::vector<RecordedCounts>(commandBuffers.size(), RecordedCounts{}));
+		layerCommandBuffers.resize(numLayers);
+		layerDirty.assign(numLayers, std::vector<bool>(commandBuffers.size(), true));
+		// the visibility survives the swap chain recreation
+		layerVisible.resize(numLayers, true);
+		primaryDirty.assign(commandBuffers.size(), true);
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		for (int l = 0; l < numLayers; l++) {
+			layerCommandBuffers[l].resize(commandBuffers.size());
+			allocInfo.commandPool = recordingPools[l % recordingPools.size()];
+			result = vkAllocateCommandBuffers(device, &allocInfo,
+					layerCommandBuffers[l].data());
+			if (result != VK_SUCCESS) {
+			 	PrintVkError(result);
+				throw std::runtime_error("failed to allocate command buffers!");
+			}
+		}
 		
+		std::vector<std::pair<int, size_t>> jobs;
+		for (int l = 0; l < numLayers; l++) {
+			for (size_t i = 0; i < commandBuffers.size(); i++) {
+				jobs.push_back({l, i});
+			}
+		}
+		recordLayers(jobs);
 		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // Optional
-			beginInfo.pInheritanceInfo = nullptr; // Optional
+			recordPrimary(i);
+		}
+	}
+
+	void freeCommandBuffers() {
+		vkFreeCommandBuffers(device, commandPool,
+				static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		for (size_t l = 0; l < layerCommandBuffers.size(); l++) {
+			vkFreeCommandBuffers(device, recordingPools[l % recordingPools.size()],
+					static_cast<uint32_t>(layerCommandBuffers[l].size()), layerCommandBuffers[l].data());
+		}
+		layerCommandBuffers.clear();
+		destroyTimestampPools();
+	}
+
+	// Waits for every frame submitted, e.g. before destroying the buffers they read
+	void waitDeviceIdle() {
+		vkDeviceWaitIdle(device);
+	}
+
+	// The layer will be recorded again, for each swap chain image, before the image is drawn
+	void markLayerDirty(int layer) {
+		std::fill(layerDirty[layer].begin(), layerDirty[layer].end(), true);
+		std::fill(primaryDirty.begin(), primaryDirty.end(), true);
+	}
+
+	// A hidden layer is simply not executed: nothing else is recorded again
+	void setLayerVisible(int layer, bool visible) {
+		if (layerVisible[layer] != visible) {
+			layerVisible[layer] = visible;
+			std::fill(primaryDirty.begin(), primaryDirty.end(), true);
+		}
+	}
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
-						VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer!");
+	bool isLayerVisible(int layer) {
+		return layerVisible[layer];
+	}
+
+	// Counts of the layer being recorded in commandBuffer, nullptr if it is not a layer. Each one is only
+	// written by the thread recording it.
+	RecordedCounts *recordedCounts(VkCommandBuffer commandBuffer) {
+		for (size_t l = 0; l < layerCommandBuffers.size(); l++) {
+			for (size_t i = 0; i < layerCommandBuffers[l].size(); i++) {
+				if (layerCommandBuffers[l][i] == commandBuffer) {
+					return &layerCounts[l][i];
+				}
 			}
-			
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass; 
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = {0, 0};
-			renderPassInfo.renderArea.extent = swapChainExtent;
-	
-			std::array<VkClearValue, 2> clearValues{};
-			clearValues[0].color = initialBackgroundColor;
-			clearValues[1].depthStencil = {1.0f, 0};
-	
-			renderPassInfo.clearValueCount =
-							static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
-			
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
-					VK_SUBPASS_CONTENTS_INLINE);			
-	
+		}
+		return nullptr;
+	}
 
-			populateCommandBuffer(commandBuffers[i], i);
-			
+	void printBenchmark() {
+		uint64_t frames = std::max<uint64_t>(frameCounters.frames, 1);
+		std::cout << "Benchmark: " << frameCounters.frames << " frames of "
+				  << swapChainExtent.width << "x" << swapChainExtent.height << "\n";
+		Profiler &profiler = Profiler::getInstance();
+		for (const char *name : {"frame", "update", "record", "gpu frame"}) {
+			int section = profiler.getSection(name);
+			if (profiler.getSections()[section].count > 0) {
+				printf("%-10s p50 %8.3f ms   p95 %8.3f ms   p99 %8.3f ms\n", name,
+						profiler.getPercentile(section, 0.5f), profiler.getPercentile(section, 0.95f),
+						profiler.getPercentile(section, 0.99f));
+			}
+		}
+		std::cout << "Per frame: " << frameCounters.uploadedBytes / frames << " bytes uploaded, "
+				  << frameCounters.draws / frames << " draws, "
+				  << frameCounters.descriptorBinds / frames << " descriptor binds\n" << std::flush;
+	}
 
-			vkCmdEndRenderPass(commandBuffers[i]);
+	// Records again what changed for image i: to be called while the image is not in flight.
+	// Returns false if nothing had to be recorded.
+	bool refreshCommandBuffers(size_t i) {
+		std::vector<std::pair<int, size_t>> jobs;
+		for (int l = 0; l < numLayers; l++) {
+			if (layerDirty[l][i]) {
+				jobs.push_back({l, i});
+				// a primary command buffer is invalidated when a secondary it executes is recorded again
+				primaryDirty[i] = true;
+			}
+		}
+		recordLayers(jobs);
+		if (primaryDirty[i]) {
+			recordPrimary(i);
+			return true;
+		}
+		return false;
+	}
 
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer!");
+	// Records the (layer, image) secondary command buffers on the workers, and waits for them
+	void recordLayers(const std::vector<std::pair<int, size_t>> &jobs) {
+		if (jobs.empty()) {
+			return;
+		}
+		if (jobs.size() == 1) {
+			// not worth waking a worker: the main thread can use its pool while it is idle
+			recordLayer(jobs[0].first, jobs[0].second);
+		} else {
+			std::unique_lock<std::mutex> lock(recordingMutex);
+			for (const std::pair<int, size_t> &job : jobs) {
+				recordingJobs[job.first % recordingJobs.size()].push_back(job);
+			}
+			recordingPending = static_cast<int>(recordingJobs.size());
+			recordingGeneration++;
+			recordingStart.notify_all();
+			recordingDone.wait(lock, [&] { return recordingPending == 0; });
+			if (recordingError) {
+				std::exception_ptr error = recordingError;
+				recordingError = nullptr;
+				std::rethrow_exception(error);
 			}
 		}
+		// layerDirty is a vector<bool>: its flags share words, so they are only written here
+		for (const std::pair<int, size_t> &job : jobs) {
+			layerDirty[job.first][job.second] = false;
+		}
+	}
+
+	void recordLayer(int layer, size_t i) {
+		VkCommandBuffer commandBuffer = layerCommandBuffers[layer][i];
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = swapChainFramebuffers[i];
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
+
+		layerCounts[layer][i] = {};
+		// the layers overlap in the pipeline: their times are upper bounds, the frame time is exact
+		if (!timestampPools.empty()) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPools[i], 2 * layer);
+		}
+		populateCommandBuffer(commandBuffer, i, layer);
+		if (!timestampPools.empty()) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPools[i], 2 * layer + 1);
+		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
+
+	void recordPrimary(size_t i) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = 0; // Optional
+		beginInfo.pInheritanceInfo = nullptr; // Optional
+
+		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
+					VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
+
+		// the queries can only be reset outside of the render pass
+		if (!timestampPools.empty()) {
+			vkCmdResetQueryPool(commandBuffers[i], timestampPools[i], 0, 2 * numLayers + 2);
+			vkCmdWriteTimestamp(commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPools[i], 2 * numLayers);
+		}
+		
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass; 
+		renderPassInfo.framebuffer = swapChainFramebuffers[i];
+		renderPassInfo.renderArea.offset = {0, 0};
+		renderPassInfo.renderArea.extent = swapChainExtent;
+
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = initialBackgroundColor;
+		clearValues[1].depthStencil = {1.0f, 0};
+
+		renderPassInfo.clearValueCount =
+						static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+		
+		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
+				VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);			
+
+		std::vector<VkCommandBuffer> visibleLayers;
+		for (int l = 0; l < numLayers; l++) {
+			if (layerVisible[l]) {
+				visibleLayers.push_back(layerCommandBuffers[l][i]);
+			}
+		}
+		if (!visibleLayers.empty()) {
+			vkCmdExecuteCommands(commandBuffers[i],
+					static_cast<uint32_t>(visibleLayers.size()), visibleLayers.data());
+		}
+
+		vkCmdEndRenderPass(commandBuffers[i]);
+
+		if (!timestampPools.empty()) {
+			vkCmdWriteTimestamp(commandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPools[i], 2 * numLayers + 1);
+		}
+
+		if (exporting) {
+			recordReadback(commandBuffers[i], static_cast<uint32_t>(i), readbackBuffers[i]);
+		}
+
+		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+		primaryDirty[i] = false;
 	}
     
     void createSyncObjects() {
@@ -1578,54 +2884,140 @@ std::cout << "Starting createInstance()\n"  << std::flush;
         while (!glfwWindowShouldClose(window)){
             glfwPollEvents();
             drawFrame();
+            afterFrame();
         }
         
         vkDeviceWaitIdle(device);
     }
     
     void drawFrame() {
-		vkWaitForFences(device, 1, &inFlightFences[currentFrame],
-						VK_TRUE, UINT64_MAX);
+		ScopedTimer frameTimer("frame");
+		uint64_t allocations = getAllocationCount();
+		// an export hands its frames to the encoders, which takes memory now and then
+		bool steady = !exporting && uploadCommandBuffer == VK_NULL_HANDLE;
+
+		// models created after the initialization
+		flushUploads();
+		// the frame may upload more itself (e.g. the tiles of a map)
+		uint64_t uploads = submittedUploads;
+
+		{
+			ScopedTimer timer("wait frame");
+			vkWaitForFences(device, 1, &inFlightFences[currentFrame],
+							VK_TRUE, UINT64_MAX);
+		}
+		for (VkSemaphore s : asyncUploadsRetired[currentFrame]) {
+			vkDestroySemaphore(device, s, nullptr);
+		}
+		asyncUploadsRetired[currentFrame].clear();
+		{
+			ScopedTimer timer("uploads");
+			if (headless) {
+				// every frame drawn as if the textures had been loaded at once
+				finishAsyncUploads();
+			} else {
+				pollAsyncUploads();
+			}
+		}
 		
 		uint32_t imageIndex;
+		VkResult result;
 		
-		VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
-				imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-
-		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-			recreateSwapChain();
-			return;
-		} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-			throw std::runtime_error("failed to acquire swap chain image!");
+		if (headless) {
+			// no presentation engine: the offscreen images are used in turn
+			imageIndex = static_cast<uint32_t>(currentFrame % swapChainImages.size());
+		} else {
+			ScopedTimer timer("acquire");
+			result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
+					imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+			if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+				recreateSwapChain();
+				return;
+			} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+				throw std::runtime_error("failed to acquire swap chain image!");
+			}
 		}
 
 		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+			ScopedTimer timer("wait image");
 			vkWaitForFences(device, 1, &imagesInFlight[imageIndex],
 							VK_TRUE, UINT64_MAX);
 		}
 		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+		readTimestamps(imageIndex);
+
+		if (exporting && readbackFrames[imageIndex] >= 0) {
+			// the frame drawn the last time in this image is complete: it goes to the encoders
+			exporter->add(readbackFrames[imageIndex], readbackBuffersMemory[imageIndex].mapped);
+			readbackFrames[imageIndex] = -1;
+		}
 		
-		updateUniformBuffer(imageIndex);
+		{
+			ScopedTimer timer("update");
+			updateUniformBuffer(imageIndex);
+			submitAsyncUploads();
+		}
+		{
+			// the image is not in flight anymore: its layers can be recorded again
+			ScopedTimer timer("record");
+			if (refreshCommandBuffers(imageIndex)) {
+				steady = false;
+			}
+		}
+		frameCounters.frames++;
+		for (int l = 0; l < numLayers; l++) {
+			if (layerVisible[l]) {
+				frameCounters.draws += layerCounts[l][imageIndex].draws;
+				frameCounters.descriptorBinds += layerCounts[l][imageIndex].descriptorBinds;
+			}
+		}
 		
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-		VkPipelineStageFlags waitStages[] =
-			{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
+		// the image, and the uploads seen complete in this frame (the textures are read by the fragment shaders)
+		frameWaitSemaphores.clear();
+		frameWaitStages.clear();
+		if (!headless) {
+			frameWaitSemaphores.push_back(imageAvailableSemaphores[currentFrame]);
+			frameWaitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		}
+		for (VkSemaphore s : asyncUploadWaits) {
+			frameWaitSemaphores.push_back(s);
+			frameWaitStages.push_back(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		}
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(frameWaitSemaphores.size());
+		submitInfo.pWaitSemaphores = frameWaitSemaphores.data();
+		submitInfo.pWaitDstStageMask = frameWaitStages.data();
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
 		VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 		
 		vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
-		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo,
-				inFlightFences[currentFrame]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to submit draw command buffer!");
+		{
+			ScopedTimer timer("submit");
+			if (vkQueueSubmit(graphicsQueue, 1, &submitInfo,
+					inFlightFences[currentFrame]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to submit draw command buffer!");
+			}
+		}
+		// destroyed once this frame is complete
+		std::swap(asyncUploadWaits, asyncUploadsRetired[currentFrame]);
+		if (!timestampPools.empty()) {
+			timestampsWritten[imageIndex] = true;
+		}
+		checkFrameAllocations(getAllocationCount() - allocations, steady && submittedUploads == uploads);
+
+		if (headless) {
+			if (exporting) {
+				readbackFrames[imageIndex] = exportedFrames++;
+			}
+			lastImageIndex = imageIndex;
+			currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+			return;
 		}
 		
 		VkPresentInfoKHR presentInfo{};
@@ -1639,7 +3031,10 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr; // Optional
 		
-		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		{
+			ScopedTimer timer("present");
+			result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
 			framebufferResized) {
@@ -1652,7 +3047,27 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     }
 
+	// The first frames are not checked: they take the memory that the next ones reuse
+	// (e.g. the sections of the profiler)
+	void checkFrameAllocations(uint64_t allocations, bool steady) {
+		const int maxWarnings = 10;
+		if (allocations == 0 || !steady || frameCounters.frames <= 2 * swapChainImages.size() ||
+			allocationWarnings >= maxWarnings) {
+			return;
+		}
+		std::cerr << "Frame " << frameCounters.frames << ": " << allocations
+				  << " heap allocations, though nothing was recorded or uploaded\n";
+		if (++allocationWarnings == maxWarnings) {
+			std::cerr << "No more warnings about the allocations of the frames\n";
+		}
+	}
+
 	virtual void updateUniformBuffer(uint32_t currentImage) = 0;
+	// Work of the render loop that is not part of the frames (e.g. other windows): done once each frame
+	// is submitted, while the GPU draws it
+	virtual void afterFrame() {}
+	// A texture loaded with Texture::initAsync can be drawn from this frame on
+	virtual void onTextureReady(Texture *texture) {}
 
 	virtual void pipelinesAndDescriptorSetsCleanup() = 0;
 	virtual void localCleanup() = 0;
@@ -1686,18 +3101,17 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	void cleanupSwapChain() {
     	vkDestroyImageView(device, colorImageView, nullptr);
     	vkDestroyImage(device, colorImage, nullptr);
-    	vkFreeMemory(device, colorImageMemory, nullptr);
+    	freeMemory(colorImageMemory);
     	
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
+		freeMemory(depthImageMemory);
 
 		for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 			vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 		}
 		
-		vkFreeCommandBuffers(device, commandPool,
-				static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		freeCommandBuffers();
 				
 		pipelinesAndDescriptorSetsCleanup();
 
@@ -1707,13 +3121,28 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 		}
 		
-		vkDestroySwapchainKHR(device, swapChain, nullptr);
+		if (headless) {
+			for (size_t i = 0; i < swapChainImages.size(); i++) {
+				vkDestroyImage(device, swapChainImages[i], nullptr);
+				freeMemory(offscreenImagesMemory[i]);
+			}
+			for (size_t i = 0; i < readbackBuffers.size(); i++) {
+				vkDestroyBuffer(device, readbackBuffers[i], nullptr);
+				freeMemory(readbackBuffersMemory[i]);
+			}
+			readbackBuffers.clear();
+			readbackBuffersMemory.clear();
+		} else {
+			vkDestroySwapchainKHR(device, swapChain, nullptr);
+		}
 
-		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		destroyDescriptorPools();
+		destroyUniformArena();
 	}
 		
     void cleanup() {
 		cleanupSwapChain();
+		releaseAsyncUploads();
     	 	
 		localCleanup();
     	
@@ -1723,18 +3152,26 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			vkDestroyFence(device, inFlightFences[i], nullptr);
     	}
     	
+		destroyRecordingWorkers();
     	vkDestroyCommandPool(device, commandPool, nullptr);
+    	vkDestroyCommandPool(device, transferCommandPool, nullptr);
+
+		destroyMemoryBlocks();
     	
  		vkDestroyDevice(device, nullptr);
 		
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 		
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		if (!headless) {
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+		}
     	vkDestroyInstance(instance, nullptr);
 
-        glfwDestroyWindow(window);
+		if (!headless) {
+	        glfwDestroyWindow(window);
 
-        glfwTerminate();
+	        glfwTerminate();
+		}
     }
 	
 	void RebuildPipeline() {
@@ -1785,6 +3222,12 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		deltaT = time - lastTime;
 		lastTime = time;
 
+		// no input without a window, and the same time step at any speed of the renderer
+		if (headless) {
+			deltaT = headlessDeltaT;
+			return;
+		}
+
 		static double old_xpos = 0, old_ypos = 0;
 		double xpos, ypos;
 		glfwGetCursorPos(window, &xpos, &ypos);
@@ -1895,8 +3338,11 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 	Color.hasIt = false; Color.offset = 0;
 	Tangent.hasIt = false; Tangent.offset = 0;
 	
-	if(B.size() == 1) {	// for now, read models only with every vertex information in a single binding
+	if(B.size() >= 1) {	// models are read in the first binding, the others (e.g. per-instance data) are filled by the application
 		for(int i = 0; i < E.size(); i++) {
+			if(E[i].binding != B[0].binding) {
+				continue;
+			}
 			switch(E[i].usage) {
 			  case VertexDescriptorElementUsage::POSITION:
 			    if(E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
@@ -1963,7 +3409,7 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 			}
 		}
 	} else {
-		throw std::runtime_error("Vertex format with more than one binding is not supported yet\n");
+		throw std::runtime_error("Vertex format without bindings\n");
 	}
 }
 
@@ -2233,34 +3679,27 @@ void Model<Vert>::loadModelGLTF(std::string file) {
 			  << "\nIndices: " << indices.size() << "\n";
 }
 
+// The geometry goes to device local memory, copied with the next batch of uploads (see BaseProject::flushUploads)
 template <class Vert>
 void Model<Vert>::createVertexBuffer() {
 	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+						VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 						vertexBuffer, vertexBufferMemory);
-
-	void* data;
-	vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, vertexBufferMemory);			
+	BP->uploadBuffer(vertices.data(), bufferSize, vertexBuffer);
 }
 
 template <class Vert>
 void Model<Vert>::createIndexBuffer() {
 	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+							 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+							 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 							 indexBuffer, indexBufferMemory);
-
-	void* data;
-	vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, indexBufferMemory);
+	BP->uploadBuffer(indices.data(), bufferSize, indexBuffer);
 }
 
 template <class Vert>
@@ -2289,9 +3728,9 @@ void Model<Vert>::init(BaseProject *bp, VertexDescriptor *vd, std::string file,
 template <class Vert>
 void Model<Vert>::cleanup() {
    	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
-   	vkFreeMemory(BP->device, indexBufferMemory, nullptr);
+   	BP->freeMemory(indexBufferMemory);
 	vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
-   	vkFreeMemory(BP->device, vertexBufferMemory, nullptr);
+   	BP->freeMemory(vertexBufferMemory);
 }
 
 template <class Vert>
@@ -2338,25 +3777,30 @@ void Texture::createTextureImage(const char *const files[], VkFormat Fmt = VK_FO
 		}
 	}
 	
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	VkDeviceSize totalImageSize = texWidth * texHeight * 4 * imgs;
+	createTextureImageFromPixels(pixels, texWidth, texHeight, 4, Fmt);
+	for(int i = 0; i < imgs; i++) {
+		stbi_image_free(pixels[i]);
+	}
+}
+
+void Texture::createTextureImageFromPixels(const unsigned char *const pixels[], int texWidth, int texHeight,
+										   int pixelSize, VkFormat Fmt) {
+	VkDeviceSize imageSize = texWidth * texHeight * pixelSize;
+	VkDeviceSize totalImageSize = imageSize * imgs;
 	mipLevels = static_cast<uint32_t>(std::floor(
 					std::log2(std::max(texWidth, texHeight)))) + 1;
 	
 	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	MemoryAllocation stagingBufferMemory;
 	 
 	BP->createBuffer(totalImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 	  						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 	  						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 	  						stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(BP->device, stagingBufferMemory, 0, totalImageSize, 0, &data);
+	void* data = stagingBufferMemory.mapped;
 	for(int i = 0; i < imgs; i++) {
 		memcpy(static_cast<char *>(data) + imageSize * i, pixels[i], static_cast<size_t>(imageSize));
-		stbi_image_free(pixels[i]);
 	}
-	vkUnmapMemory(BP->device, stagingBufferMemory);
 	
 	
 	BP->createImage(texWidth, texHeight, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
@@ -2375,7 +3819,7 @@ void Texture::createTextureImage(const char *const files[], VkFormat Fmt = VK_FO
 					texWidth, texHeight, mipLevels, imgs);
 
 	vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
-	vkFreeMemory(BP->device, stagingBufferMemory, nullptr);
+	BP->freeMemory(stagingBufferMemory);
 }
 
 void Texture::createTextureImageView(VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
@@ -2437,6 +3881,15 @@ void Texture::init(BaseProject *bp, const char *  file, VkFormat Fmt = VK_FORMAT
 }
 
 
+void Texture::initPixels(BaseProject *bp, const unsigned char *pixels, int width, int height, int pixelSize, VkFormat Fmt) {
+	BP = bp;
+	imgs = 1;
+	createTextureImageFromPixels(&pixels, width, height, pixelSize, Fmt);
+	createTextureImageView(Fmt);
+	createTextureSampler();
+}
+
+
 void Texture::initCubic(BaseProject *bp, const char * files[6]) {
 	BP = bp;
 	imgs = 6;
@@ -2446,11 +3899,59 @@ void Texture::initCubic(BaseProject *bp, const char * files[6]) {
 }
 
 
+void Texture::initArray(BaseProject *bp, int width, int height, int layers, VkFormat Fmt) {
+	BP = bp;
+	imgs = layers;
+	mipLevels = static_cast<uint32_t>(std::floor(
+					std::log2(std::max(width, height)))) + 1;
+
+	BP->createImage(width, height, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
+				textureImageMemory, true);
+	// every layer in the layout the uploads expect, even before the first one
+	BP->transitionImageLayout(textureImage, Fmt,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, imgs);
+	BP->transitionImageLayout(textureImage, Fmt,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels, imgs);
+
+	textureImageView = BP->createImageView(textureImage, Fmt, VK_IMAGE_ASPECT_COLOR_BIT,
+									   mipLevels, VK_IMAGE_VIEW_TYPE_2D_ARRAY, imgs);
+	createTextureSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR,
+						 VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+}
+
+
+void Texture::initAsync(BaseProject *bp, const char *file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
+	BP = bp;
+	imgs = 1;
+	// just the size for now: the image is created empty
+	int texWidth, texHeight, texChannels;
+	if (!stbi_info(file, &texWidth, &texHeight, &texChannels)) {
+		std::cout << "Not found: " << file << "\n";
+		throw std::runtime_error("failed to load texture image!");
+	}
+	mipLevels = mipLevelsOf(texWidth, texHeight);
+
+	BP->createImage(texWidth, texHeight, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
+				textureImageMemory, true);
+	createTextureImageView(Fmt);
+	createTextureSampler();
+
+	ready = false;
+	BP->asyncTextures.push_back(BaseProject::AsyncTexture{this, 0});
+	BP->imageLoader.load(static_cast<int>(BP->asyncTextures.size()) - 1, file, Fmt == VK_FORMAT_R8G8B8A8_SRGB);
+}
+
+
 void Texture::cleanup() {
    	vkDestroySampler(BP->device, textureSampler, nullptr);
    	vkDestroyImageView(BP->device, textureImageView, nullptr);
 	vkDestroyImage(BP->device, textureImage, nullptr);
-	vkFreeMemory(BP->device, textureImageMemory, nullptr);
+	BP->freeMemory(textureImageMemory);
 }
 
 
@@ -2752,37 +4253,41 @@ void DescriptorSetLayout::cleanup() {
 void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 						 std::vector<DescriptorSetElement> E) {
 	BP = bp;
+	size_t numImages = BP->swapChainImages.size();
 	
-	uniformBuffers.resize(E.size());
-	uniformBuffersMemory.resize(E.size());
-	toFree.resize(E.size());
+	// the uniforms are sub-allocated in the arena, already mapped
+	uniformData.assign(E.size(), std::vector<void *>(numImages, nullptr));
+	std::vector<uint32_t> uniformBlock(E.size());
+	std::vector<VkDeviceSize> uniformOffset(E.size());
+	uint32_t numUniforms = 0, numTextures = 0, numStorageBuffers = 0;
 
 	for (int j = 0; j < E.size(); j++) {
-		uniformBuffers[j].resize(BP->swapChainImages.size());
-		uniformBuffersMemory[j].resize(BP->swapChainImages.size());
 		if(E[j].type == UNIFORM) {
-			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-				VkDeviceSize bufferSize = E[j].size;
-				BP->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-									 	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-									 	 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-									 	 uniformBuffers[j][i], uniformBuffersMemory[j][i]);
-			}
-			toFree[j] = true;
-		} else {
-			toFree[j] = false;
+			BP->allocateUniform(E[j].size, uniformBlock[j], uniformOffset[j]);
+			for (size_t i = 0; i < numImages; i++) {
+				const BaseProject::UniformArenaBlock &block = BP->uniformArena[uniformBlock[j]];
+				uniformData[j][i] = block.mapped + block.regionSize * i + uniformOffset[j];
+			}
+			numUniforms++;
+		} else if(E[j].type == TEXTURE) {
+			numTextures++;
+		} else if(E[j].type == STORAGE) {
+			numStorageBuffers++;
 		}
 	}
 	
-	std::vector<VkDescriptorSetLayout> layouts(BP->swapChainImages.size(),
+	std::vector<VkDescriptorSetLayout> layouts(numImages,
 											   DSL->descriptorSetLayout);
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = BP->descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(BP->swapChainImages.size());
+	allocInfo.descriptorPool = BP->reserveDescriptors(static_cast<uint32_t>(numImages),
+											numUniforms * static_cast<uint32_t>(numImages),
+											numTextures * static_cast<uint32_t>(numImages),
+											numStorageBuffers * static_cast<uint32_t>(numImages));
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(numImages);
 	allocInfo.pSetLayouts = layouts.data();
 	
-	descriptorSets.resize(BP->swapChainImages.size());
+	descriptorSets.resize(numImages);
 	
 	VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo,
 										descriptorSets.data());
@@ -2791,14 +4296,15 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
 	
-	for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
+	for (size_t i = 0; i < numImages; i++) {
 		std::vector<VkWriteDescriptorSet> descriptorWrites(E.size());
 		std::vector<VkDescriptorBufferInfo> bufferInfo(E.size());
 		std::vector<VkDescriptorImageInfo> imageInfo(E.size());
 		for (int j = 0; j < E.size(); j++) {
 			if(E[j].type == UNIFORM) {
-				bufferInfo[j].buffer = uniformBuffers[j][i];
-				bufferInfo[j].offset = 0;
+				const BaseProject::UniformArenaBlock &block = BP->uniformArena[uniformBlock[j]];
+				bufferInfo[j].buffer = block.buffer;
+				bufferInfo[j].offset = block.regionSize * i + uniformOffset[j];
 				bufferInfo[j].range = E[j].size;
 				
 				descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -2821,6 +4327,18 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 											VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 				descriptorWrites[j].descriptorCount = 1;
 				descriptorWrites[j].pImageInfo = &imageInfo[j];
+			} else if(E[j].type == STORAGE) {
+				bufferInfo[j].buffer = E[j].buf->buffer;
+				bufferInfo[j].offset = 0;
+				bufferInfo[j].range = VK_WHOLE_SIZE;
+
+				descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[j].dstSet = descriptorSets[i];
+				descriptorWrites[j].dstBinding = E[j].binding;
+				descriptorWrites[j].dstArrayElement = 0;
+				descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				descriptorWrites[j].descriptorCount = 1;
+				descriptorWrites[j].pBufferInfo = &bufferInfo[j];
 			}
 		}		
 		vkUpdateDescriptorSets(BP->device,
@@ -2829,19 +4347,19 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 	}
 }
 
+// The uniforms and the descriptor sets are given back all together, with the arena and the pools,
+// when the swap chain is cleaned up
 void DescriptorSet::cleanup() {
-	for(int j = 0; j < uniformBuffers.size(); j++) {
-		if(toFree[j]) {
-			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-				vkDestroyBuffer(BP->device, uniformBuffers[j][i], nullptr);
-				vkFreeMemory(BP->device, uniformBuffersMemory[j][i], nullptr);
-			}
-		}
-	}
+	uniformData.clear();
+	descriptorSets.clear();
 }
 
 void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
 						 int currentImage) {
+	BaseProject::RecordedCounts *counts = BP->recordedCounts(commandBuffer);
+	if (counts) {
+		counts->descriptorBinds++;
+	}
 	vkCmdBindDescriptorSets(commandBuffer,
 					VK_PIPELINE_BIND_POINT_GRAPHICS,
 					P.pipelineLayout, setId, 1, &descriptorSets[currentImage],
@@ -2849,10 +4367,85 @@ void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
 }
 
 void DescriptorSet::map(int currentImage, void *src, int size, int slot) {
-	void* data;
+	memcpy(uniformData[slot][currentImage], src, size);
+	BP->frameCounters.uploadedBytes += size;
+}
+
+void InstanceBuffer::init(BaseProject *bp, VkDeviceSize size) {
+	BP = bp;
+	this->size = size;
+
+	buffers.resize(BP->swapChainImages.size());
+	buffersMemory.resize(BP->swapChainImages.size());
+	mapped.resize(BP->swapChainImages.size());
+	for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
+		BP->createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+							 buffers[i], buffersMemory[i]);
+		mapped[i] = buffersMemory[i].mapped;
+	}
+}
+
+void InstanceBuffer::cleanup() {
+	for (size_t i = 0; i < buffers.size(); i++) {
+		vkDestroyBuffer(BP->device, buffers[i], nullptr);
+		BP->freeMemory(buffersMemory[i]);
+	}
+	buffers.clear();
+	buffersMemory.clear();
+	mapped.clear();
+}
+
+void InstanceBuffer::bind(VkCommandBuffer commandBuffer, uint32_t binding, int currentImage) {
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, binding, 1, &buffers[currentImage], offsets);
+}
+
+void InstanceBuffer::map(int currentImage, const void *src, VkDeviceSize size, VkDeviceSize offset) {
+	size = std::min(size, this->size - std::min(offset, this->size));
+	memcpy((char *)mapped[currentImage] + offset, src, (size_t)size);
+	BP->frameCounters.uploadedBytes += size;
+}
+
+void StorageBuffer::init(BaseProject *bp, VkDeviceSize size, const void *data, bool dynamic) {
+	BP = bp;
+	this->size = size;
+	mapped = nullptr;
+
+	VkMemoryPropertyFlags properties = dynamic ?
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	if(size > BP->maxStorageBufferSize(properties)) {
+		throw std::runtime_error("failed to create storage buffer of " + std::to_string(size) + " bytes, more than the device can bind!");
+	}
+
+	if(dynamic) {
+		BP->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+							 buffer, bufferMemory);
+		mapped = bufferMemory.mapped;
+		memcpy(mapped, data, (size_t) size);
+		return;
+	}
+
+	BP->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+						 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						 buffer, bufferMemory);
+	BP->uploadBuffer(data, size, buffer);
+}
+
+void StorageBuffer::write(VkDeviceSize offset, const void *src, VkDeviceSize size) {
+	if(!mapped) {
+		throw std::runtime_error("failed to write a storage buffer that is not dynamic!");
+	}
+	memcpy((char *)mapped + offset, src, (size_t) size);
+	BP->frameCounters.uploadedBytes += size;
+}
 
-	vkMapMemory(BP->device, uniformBuffersMemory[slot][currentImage], 0,
-						size, 0, &data);
-	memcpy(data, src, size);
-	vkUnmapMemory(BP->device, uniformBuffersMemory[slot][currentImage]);	
+void StorageBuffer::cleanup() {
+	vkDestroyBuffer(BP->device, buffer, nullptr);
+	BP->freeMemory(bufferMemory);
 }
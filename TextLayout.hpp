@@ -0,0 +1,130 @@
+#ifndef TEXTLAYOUT_HPP
+#define TEXTLAYOUT_HPP
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+struct SingleText {
+	int usedLines;
+	const char *l[4];
+	int start;
+	int len;
+};
+
+struct CharData {
+	int x;
+	int y;
+	int width;
+	int height;
+	int xoffset;
+	int yoffset;
+	int xadvance;
+};
+
+// Height of the lines of the fonts of the texts, in pixels of the 800 x 600 screen the overlay is scaled from:
+// all drawn from the same distance field atlas (see FontAtlas)
+const float FontSizes[] = {73, 30, 16};
+
+struct TextVertex {
+	glm::vec2 pos;
+	glm::vec2 texCoord;
+};
+
+// Metrics of the characters of a font at one size, indexed directly by their code: nullptr for the ones it
+// does not have. The metrics are in pixels of the atlas, scale turns them into the pixels of the overlay.
+struct GlyphTable {
+	const CharData *glyphs[256];
+	float lineHeight;
+	float scale;
+	int texW;
+	int texH;
+};
+
+// Writes the 4 vertices of the quad of a character placed at (tpx, tpy), in pixels of the 800 x 600 screen
+// the text overlay is scaled from
+inline void layoutGlyph(const CharData &d, const GlyphTable &font, float tpx, float tpy, TextVertex *quad) {
+	const float PtoTdx = -0.95;
+	const float PtoTdy = -0.95;
+	const float PtoTsx = 2.0/800.0;
+	const float PtoTsy = 2.0/600.0;
+
+	float x0 = (tpx + d.xoffset * font.scale) * PtoTsx + PtoTdx;
+	float x1 = (tpx + (d.xoffset + d.width) * font.scale) * PtoTsx + PtoTdx;
+	float y0 = (tpy + d.yoffset * font.scale) * PtoTsy + PtoTdy;
+	float y1 = (tpy + (d.yoffset + d.height) * font.scale) * PtoTsy + PtoTdy;
+	float u0 = (float)d.x / font.texW;
+	float u1 = (float)(d.x + d.width) / font.texW;
+	float v0 = (float)d.y / font.texH;
+	float v1 = (float)(d.y + d.height) / font.texH;
+
+	quad[0] = {{x0, y0}, {u0, v0}};
+	quad[1] = {{x1, y0}, {u1, v0}};
+	quad[2] = {{x0, y1}, {u0, v1}};
+	quad[3] = {{x1, y1}, {u1, v1}};
+}
+
+// Lays out a string from (x, y), in the same pixels, at most maxGlyphs quads written in vertices; a new line
+// starts at each '\n'. Returns the number of quads written, characters missing from the font are skipped.
+inline int layoutString(const char *text, const GlyphTable &font, float x, float y, TextVertex *vertices, int maxGlyphs) {
+	float tpx = x;
+	float tpy = y;
+	int k = 0;
+	for(const char *s = text; *s && k < maxGlyphs; s++) {
+		if(*s == '\n') {
+			tpx = x;
+			tpy += font.lineHeight;
+			continue;
+		}
+		const CharData *d = font.glyphs[(unsigned char)*s];
+		if(d) {
+			layoutGlyph(*d, font, tpx, tpy, &vertices[4 * k]);
+			tpx += d->xadvance * font.scale;
+			k++;
+		}
+	}
+	return k;
+}
+
+// Lays out the lines of the texts in font, a quad (4 vertices, 6 indices) per character in the screen
+// coordinates of the text overlay, and sets where each text starts in the indices and how many it has.
+// Apart from TextMaker, it does not need Vulkan: the microbenchmarks time it alone.
+inline void layoutText(std::vector<SingleText> &Texts, const GlyphTable &font, std::vector<TextVertex> &vertices, std::vector<uint32_t> &indices) {
+	int totLen = 0;
+	for(auto& Txt : Texts) {
+		for(int i = 0; i < Txt.usedLines; i++) {
+			for(const char *s = Txt.l[i]; *s; s++) {
+				totLen += font.glyphs[(unsigned char)*s] ? 1 : 0;
+			}
+		}
+	}
+	
+	vertices.resize(4 * totLen);
+	indices.resize(6 * totLen);
+	
+	float tpy = 0;
+	
+	int ib = 0, k = 0;
+	for(auto& Txt : Texts) {
+		Txt.start = ib;
+		for(int i = 0; i < Txt.usedLines; i++) {
+			int len = layoutString(Txt.l[i], font, 0, tpy, vertices.data() + 4 * k, totLen - k);
+			for(int j = 0; j < len; j++, k++) {
+				indices[ib + 0] = 4 * k + 0;
+				indices[ib + 1] = 4 * k + 1;
+				indices[ib + 2] = 4 * k + 2;
+				indices[ib + 3] = 4 * k + 1;
+				indices[ib + 4] = 4 * k + 2;
+				indices[ib + 5] = 4 * k + 3;
+				ib += 6;
+			}
+			tpy += font.lineHeight;
+		}
+		tpy = 0;
+		Txt.len = ib - Txt.start;
+	}
+}
+
+#endif // TEXTLAYOUT_HPP
@@ -0,0 +1,299 @@
+#include "TileStreamer.hpp"
+#include "ImageLoader.hpp"
+#include "FileInfo.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// The implementations are compiled with Starter.hpp
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+namespace {
+
+bool isDirectory(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+void makeDirectory(const std::string &path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// The part [x0, x1) x [y0, y1) of an RGBA image, in a new tile (malloc'ed, as the images of stb_image):
+// each pixel of the tile averages the pixels of the image it covers, or is interpolated between the nearest
+// ones where the tile has more pixels than the image
+unsigned char *resample(const unsigned char *src, int width, int height, float x0, float y0, float x1, float y1) {
+    const int size = TileStreamer::TILE_SIZE;
+    unsigned char *dst = (unsigned char *)malloc((size_t)size * size * 4);
+    float sx = (x1 - x0) / size;
+    float sy = (y1 - y0) / size;
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            float sum[4] = {0, 0, 0, 0};
+            if (sx >= 1.0f && sy >= 1.0f) {
+                int c0 = std::min((int)(x0 + i * sx), width - 1);
+                int c1 = std::max(std::min((int)std::ceil(x0 + (i + 1) * sx), width), c0 + 1);
+                int r0 = std::min((int)(y0 + j * sy), height - 1);
+                int r1 = std::max(std::min((int)std::ceil(y0 + (j + 1) * sy), height), r0 + 1);
+                for (int r = r0; r < r1; r++) {
+                    for (int c = c0; c < c1; c++) {
+                        const unsigned char *p = src + ((size_t)r * width + c) * 4;
+                        for (int k = 0; k < 4; k++) {
+                            sum[k] += p[k];
+                        }
+                    }
+                }
+                for (int k = 0; k < 4; k++) {
+                    sum[k] /= (float)((r1 - r0) * (c1 - c0));
+                }
+            } else {
+                float fx = std::min(std::max(x0 + (i + 0.5f) * sx - 0.5f, 0.0f), (float)(width - 1));
+                float fy = std::min(std::max(y0 + (j + 0.5f) * sy - 0.5f, 0.0f), (float)(height - 1));
+                int c = (int)fx;
+                int r = (int)fy;
+                int c1 = std::min(c + 1, width - 1);
+                int r1 = std::min(r + 1, height - 1);
+                float ax = fx - c;
+                float ay = fy - r;
+                const unsigned char *p00 = src + ((size_t)r * width + c) * 4;
+                const unsigned char *p01 = src + ((size_t)r * width + c1) * 4;
+                const unsigned char *p10 = src + ((size_t)r1 * width + c) * 4;
+                const unsigned char *p11 = src + ((size_t)r1 * width + c1) * 4;
+                for (int k = 0; k < 4; k++) {
+                    sum[k] = (p00[k] * (1 - ax) + p01[k] * ax) * (1 - ay) + (p10[k] * (1 - ax) + p11[k] * ax) * ay;
+                }
+            }
+            unsigned char *q = dst + ((size_t)j * size + i) * 4;
+            for (int k = 0; k < 4; k++) {
+                q[k] = (unsigned char)std::lround(std::min(sum[k], 255.0f));
+            }
+        }
+    }
+    return dst;
+}
+
+}
+
+TileStreamer::TileStreamer(const std::string &map, int numSlots, int reuseDelay)
+    : map(map), singleImage(false), maxLevel(0), reuseDelay(reuseDelay), sourceWidth(0), sourceHeight(0), source(nullptr),
+      slots(numSlots, Slot{{-1, 0, 0}, EMPTY, 0}), missing(MISSING_TILES, Tile{-1, 0, 0}), nextMissing(0),
+      busy(0), stop(false) {
+    int components;
+    if (stbi_info(map.c_str(), &sourceWidth, &sourceHeight, &components)) {
+        // down to about a pixel of the image per pixel of the tiles
+        singleImage = true;
+        while (maxLevel < MAX_LEVEL && ((int64_t)TILE_SIZE << maxLevel) < std::max(sourceWidth, sourceHeight)) {
+            maxLevel++;
+        }
+    } else if (isDirectory(map) && isDirectory(map + "/0")) {
+        while (maxLevel < MAX_LEVEL && isDirectory(map + "/" + std::to_string(maxLevel + 1))) {
+            maxLevel++;
+        }
+    } else {
+        throw std::runtime_error("failed to load map " + map + "!");
+    }
+    requests.reserve(numSlots);
+    loaded.reserve(numSlots);
+    // a tile at a time each, leaving a core to the render loop
+    int numLoaders = std::max(1, std::min(4, (int)std::thread::hardware_concurrency() - 1));
+    for (int t = 0; t < numLoaders; t++) {
+        loaders.push_back(std::thread(&TileStreamer::loadLoop, this));
+    }
+}
+
+TileStreamer::~TileStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : loaders) {
+        t.join();
+    }
+    for (LoadedTile &t : loaded) {
+        freePixels(t.pixels);
+    }
+    stbi_image_free(source);
+}
+
+int TileStreamer::getMaxLevel() const {
+    return maxLevel;
+}
+
+int TileStreamer::getNumSlots() const {
+    return (int)slots.size();
+}
+
+int TileStreamer::use(const Tile &tile, uint64_t frame) {
+    int victim = -1;
+    for (size_t i = 0; i < slots.size(); i++) {
+        Slot &s = slots[i];
+        if (s.state != EMPTY && s.tile == tile) {
+            s.lastUsed = frame;
+            return s.state == READY ? (int)i : -1;
+        }
+        // the first free slot, else the least recently used tile, if not used in the last reuseDelay frames
+        if (s.state == EMPTY) {
+            if (victim < 0 || slots[victim].state != EMPTY) {
+                victim = (int)i;
+            }
+        } else if (s.state == READY && s.lastUsed + reuseDelay < frame &&
+                   (victim < 0 || (slots[victim].state == READY && s.lastUsed < slots[victim].lastUsed))) {
+            victim = (int)i;
+        }
+    }
+    for (const Tile &t : missing) {
+        if (t == tile) {
+            return -1;
+        }
+    }
+    if (victim < 0) {
+        return -1;
+    }
+
+    slots[victim] = Slot{tile, LOADING, frame};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(LoadedTile{tile, victim, nullptr});
+    }
+    wake.notify_one();
+    return -1;
+}
+
+int TileStreamer::takeLoaded(LoadedTile *tiles, int maxTiles) {
+    int n = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t taken = 0;
+    while (taken < loaded.size() && n < maxTiles) {
+        const LoadedTile &t = loaded[taken++];
+        if (t.pixels) {
+            slots[t.slot].state = READY;
+            tiles[n++] = t;
+        } else {
+            slots[t.slot].state = EMPTY;
+            missing[nextMissing] = t.tile;
+            nextMissing = (nextMissing + 1) % MISSING_TILES;
+        }
+    }
+    loaded.erase(loaded.begin(), loaded.begin() + taken);
+    return n;
+}
+
+void TileStreamer::waitLoaded() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return requests.empty() && busy == 0; });
+}
+
+// stb_image allocates with malloc, as resample and load
+void TileStreamer::freePixels(unsigned char *pixels) {
+    free(pixels);
+}
+
+// The requests in the order they were made: the coarser tiles, asked for first, come first. Every loader
+// reads a tile at a time, and builds its mip levels as well.
+void TileStreamer::loadLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stop || !requests.empty(); });
+        if (stop) {
+            return;
+        }
+        LoadedTile request = requests.front();
+        requests.erase(requests.begin());
+        busy++;
+        lock.unlock();
+        request.pixels = load(request.tile);
+        if (request.pixels) {
+            unsigned char *chain = (unsigned char *)realloc(request.pixels, mipChainSize(TILE_SIZE, TILE_SIZE));
+            if (chain) {
+                buildMipChain(chain, TILE_SIZE, TILE_SIZE, true);
+            } else {
+                free(request.pixels);
+            }
+            request.pixels = chain;
+        }
+        lock.lock();
+        loaded.push_back(request);
+        busy--;
+        idle.notify_all();
+    }
+}
+
+std::string TileStreamer::tileName(const std::string &root, const Tile &tile) const {
+    return root + "/" + std::to_string(tile.level) + "/" + std::to_string(tile.x) + "/" + std::to_string(tile.y) + ".png";
+}
+
+// nullptr if the tile does not exist
+unsigned char *TileStreamer::load(const Tile &tile) {
+    std::string root = singleImage ? map + ".tiles" : map;
+    std::string name = tileName(root, tile);
+    uint64_t mapSize, tileSize;
+    int64_t mapMtime = 0, tileMtime = 0;
+    bool upToDate = !singleImage ||
+                    (fileInfo(map, mapSize, mapMtime) && fileInfo(name, tileSize, tileMtime) && tileMtime >= mapMtime);
+    if (upToDate) {
+        int width, height, components;
+        unsigned char *pixels = stbi_load(name.c_str(), &width, &height, &components, STBI_rgb_alpha);
+        if (pixels && (width != TILE_SIZE || height != TILE_SIZE)) {
+            unsigned char *resized = resample(pixels, width, height, 0, 0, (float)width, (float)height);
+            stbi_image_free(pixels);
+            pixels = resized;
+        }
+        if (pixels || !singleImage) {
+            return pixels;
+        }
+    }
+
+    unsigned char *pixels = cut(tile);
+    if (!pixels) {
+        return nullptr;
+    }
+    // best effort, as the other caches: written under a temporary name and renamed
+    makeDirectory(root);
+    makeDirectory(root + "/" + std::to_string(tile.level));
+    makeDirectory(root + "/" + std::to_string(tile.level) + "/" + std::to_string(tile.x));
+    std::string tmpName = name + ".tmp";
+    if (stbi_write_png(tmpName.c_str(), TILE_SIZE, TILE_SIZE, 4, pixels, TILE_SIZE * 4)) {
+        std::remove(name.c_str());
+        if (std::rename(tmpName.c_str(), name.c_str()) != 0) {
+            std::remove(tmpName.c_str());
+        }
+    }
+    return pixels;
+}
+
+unsigned char *TileStreamer::cut(const Tile &tile) {
+    if (tile.level < 0 || tile.level > maxLevel) {
+        return nullptr;
+    }
+    int n = 1 << tile.level;
+    if (tile.x < 0 || tile.x >= n || tile.y < 0 || tile.y >= n) {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sourceMutex);
+        if (!source) {
+            int components;
+            source = stbi_load(map.c_str(), &sourceWidth, &sourceHeight, &components, STBI_rgb_alpha);
+            if (!source) {
+                return nullptr;
+            }
+        }
+    }
+    float w = (float)sourceWidth / n;
+    float h = (float)sourceHeight / n;
+    return resample(source, sourceWidth, sourceHeight, tile.x * w, tile.y * h, (tile.x + 1) * w, (tile.y + 1) * h);
+}
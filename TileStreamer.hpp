@@ -0,0 +1,101 @@
+#ifndef TILESTREAMER_HPP
+#define TILESTREAMER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// The tiles of a map, read on demand by loader threads and kept in a fixed number of slots (the layers of a
+// texture array): a tile asked for when every slot is taken replaces the least recently used one.
+// The tiles form a pyramid: level 0 is the whole map in a single tile, each tile is split in 4 tiles at the
+// next level. They are read from "<map>/<level>/<x>/<y>.png" (x from the left, y from the top), or, for a map
+// given as a single image, cut from it the first time they are needed and saved in "<map>.tiles/" for the
+// next runs.
+class TileStreamer {
+    public:
+        static const int TILE_SIZE = 256;           // pixels on each side of a tile
+        static const int MAX_LEVEL = 16;
+
+        struct Tile {
+            int level;
+            int x;
+            int y;
+
+            bool operator==(const Tile &t) const {
+                return level == t.level && x == t.x && y == t.y;
+            }
+        };
+
+        // A tile read by a loader: TILE_SIZE x TILE_SIZE RGBA pixels, row after row, then its smaller mip
+        // levels (see buildMipChain), for its slot
+        struct LoadedTile {
+            Tile tile;
+            int slot;
+            unsigned char *pixels;                  // freed with freePixels once copied
+        };
+
+    private:
+        static const int MISSING_TILES = 64;
+
+        enum SlotState {EMPTY, LOADING, READY};
+
+        struct Slot {
+            Tile tile;
+            SlotState state;
+            uint64_t lastUsed;
+        };
+
+        std::string map;
+        bool singleImage;
+        int maxLevel;
+        int reuseDelay;
+        int sourceWidth;
+        int sourceHeight;
+        std::mutex sourceMutex;
+        unsigned char *source;                      // the single image, decoded by a loader when first needed
+
+        // render loop only
+        std::vector<Slot> slots;
+        std::vector<Tile> missing;                  // last tiles found not to exist, not asked for again
+        int nextMissing;
+
+        // shared with the loaders, with room for a request per slot: pushing never allocates
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::vector<LoadedTile> requests;
+        std::vector<LoadedTile> loaded;
+        int busy;                                   // requests taken by the loaders and not in loaded yet
+        bool stop;
+        std::vector<std::thread> loaders;
+
+        void loadLoop();
+        unsigned char *load(const Tile &tile);
+        unsigned char *cut(const Tile &tile);
+        std::string tileName(const std::string &root, const Tile &tile) const;
+
+    public:
+        // map: a PNG image, or a directory of tiles. numSlots: how many tiles are kept at once. reuseDelay: frames
+        // a slot keeps its tile after its last use (e.g. while the GPU may still read it)
+        TileStreamer(const std::string &map, int numSlots, int reuseDelay = 0);
+        ~TileStreamer();
+        TileStreamer(const TileStreamer &) = delete;
+        TileStreamer &operator=(const TileStreamer &) = delete;
+
+        int getMaxLevel() const;
+        int getNumSlots() const;
+
+        // The slot holding the tile, or -1 if it is not loaded: it is then asked to the loaders, unless it does
+        // not exist or every slot was used too recently. Never allocates.
+        int use(const Tile &tile, uint64_t frame);
+        // The tiles read since the last call, at most maxTiles: their slots hold them from now on
+        int takeLoaded(LoadedTile *tiles, int maxTiles);
+        // Blocks until every tile asked for is read
+        void waitLoaded();
+        static void freePixels(unsigned char *pixels);
+};
+
+#endif // TILESTREAMER_HPP
@@ -0,0 +1,81 @@
+#include "Timeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+Timeline::Timeline(float lineDuration, float step, float maxCatchUp)
+    : step(step), accumulator(0), line(0), lineSteps(0), numLines(1), loop(true), speed(1.0f), paused(false) {
+    stepsPerLine = std::max(1, (int)std::lround(lineDuration / step));
+    maxSteps = std::max(1, (int)std::lround(maxCatchUp / step));
+}
+
+void Timeline::advance(float deltaT) {
+    if (paused) {
+        return;
+    }
+    accumulator += (double)deltaT * speed;
+    long long steps = (long long)std::floor(accumulator / step);
+    accumulator -= steps * step;
+    // after a very long frame (e.g. the window was dragged) the animation does not rush through the lines
+    steps = std::min(steps, (long long)maxSteps);
+    for (long long s = 0; s < steps; s++) {
+        takeStep();
+    }
+}
+
+void Timeline::takeStep() {
+    if (lineSteps < stepsPerLine) {
+        lineSteps++;
+        return;
+    }
+    if (line + 1 < numLines) {
+        line++;
+        lineSteps = 1;
+    } else if (loop) {
+        line = 0;
+        lineSteps = 1;
+    }
+    // otherwise the last line stays, fully grown, until a new one arrives
+}
+
+void Timeline::seek(int line) {
+    this->line = std::max(0, std::min(line, numLines - 1));
+    lineSteps = stepsPerLine;
+    accumulator = 0;
+}
+
+void Timeline::setNumLines(int numLines, bool loop) {
+    this->numLines = std::max(1, numLines);
+    this->loop = loop;
+    if (line >= this->numLines) {
+        seek(this->numLines - 1);
+    }
+}
+
+void Timeline::dropLines(int dropped) {
+    line = std::max(line - dropped, 0);
+}
+
+void Timeline::setSpeed(float speed) {
+    this->speed = std::max(speed, 0.0f);
+}
+
+float Timeline::getSpeed() const {
+    return speed;
+}
+
+void Timeline::setPaused(bool paused) {
+    this->paused = paused;
+}
+
+bool Timeline::isPaused() const {
+    return paused;
+}
+
+int Timeline::getLine() const {
+    return line;
+}
+
+float Timeline::getBlend() const {
+    return (float)lineSteps / stepsPerLine;
+}
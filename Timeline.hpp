@@ -0,0 +1,47 @@
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+// Position of the animation over the lines of the data: the line reached, and how far the bars grew
+// from the previous line towards it. Time goes by in fixed steps whatever the frame rate: a slow frame
+// takes all the steps it covers (skipping lines if needed), and the same calls always give the same
+// positions, so a scripted run draws the same frames every time.
+class Timeline {
+    private:
+        double step;                // seconds of animation per step
+        int stepsPerLine;
+        int maxSteps;               // per advance(): beyond that the time is dropped instead of caught up
+        double accumulator;         // seconds not yet turned into steps
+        int line;
+        int lineSteps;              // steps spent on the current line, up to stepsPerLine
+        int numLines;
+        bool loop;                  // back to the first line after the last one, or wait there for more lines
+        float speed;
+        bool paused;
+
+        void takeStep();
+
+    public:
+        // lineDuration: seconds of animation per line, at speed 1
+        Timeline(float lineDuration = 0.5f, float step = 1.0f / 240.0f, float maxCatchUp = 10.0f);
+
+        // Adds deltaT seconds of real time (scaled by the speed) and takes the steps they cover
+        void advance(float deltaT);
+        // Jumps to a line, shown fully grown
+        void seek(int line);
+
+        // lines available; with loop false the timeline stops on the last one until more arrive
+        void setNumLines(int numLines, bool loop);
+        // the first dropped lines of a live source are gone: the following ones move back
+        void dropLines(int dropped);
+
+        void setSpeed(float speed);
+        float getSpeed() const;
+        void setPaused(bool paused);
+        bool isPaused() const;
+
+        int getLine() const;
+        // 0 on the previous line, 1 on the current one
+        float getBlend() const;
+};
+
+#endif // TIMELINE_HPP
@@ -0,0 +1,52 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+
+// Hands the last value written by one thread to another one, without locks: the writer fills back() and
+// publishes it, the reader takes the last published one with update() and reads it in front(). Neither ever
+// waits or touches the slot the other one is using. A published slot comes back to the writer later with
+// an older value in it: back() has to be written in full before each publish().
+template <class T>
+class TripleBuffer {
+    private:
+        static const int DIRTY = 4;         // in middle: published and not taken yet
+
+        T slots[3];
+        std::atomic<int> middle;            // slot exchanged between the two sides
+        int backSlot;                       // writer only
+        int frontSlot;                      // reader only
+
+    public:
+        TripleBuffer() : middle(1), backSlot(0), frontSlot(2) {}
+        TripleBuffer(const TripleBuffer &) = delete;
+        TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+        T &back() {
+            return slots[backSlot];
+        }
+
+        void publish() {
+            backSlot = middle.exchange(backSlot | DIRTY, std::memory_order_acq_rel) & ~DIRTY;
+        }
+
+        // Returns false if nothing was published since the last call: front() is unchanged
+        bool update() {
+            if ((middle.load(std::memory_order_relaxed) & DIRTY) == 0) {
+                return false;
+            }
+            frontSlot = middle.exchange(frontSlot, std::memory_order_acq_rel) & ~DIRTY;
+            return true;
+        }
+
+        const T &front() const {
+            return slots[frontSlot];
+        }
+
+        // Every slot, before the two sides start (e.g. to size them)
+        T &slot(int i) {
+            return slots[i];
+        }
+};
+
+#endif // TRIPLEBUFFER_HPP
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Times BarChart and BarChartMap, rendered without a window, on synthetic data of growing size:
+# run by "make bench", from the root of the project. Parameters, from the environment:
+#   EXEC            the program (bin/exec.out)
+#   BENCH_SIZES     rows x columns of each dataset ("1000x20 10000x100 100000x1000 1000000x100")
+#   BENCH_FRAMES    frames drawn for each dataset (600)
+#   BENCH_WIDTH, BENCH_HEIGHT   size of the frames (1280 x 720)
+#   BENCH_DIR       where the datasets, the outputs and the profiles are written (bin/bench)
+# The datasets are generated once, with a fixed seed, and kept in BENCH_DIR for the next runs.
+# The largest ones (e.g. 1000000x10000, 40 GB of values) only fit the memory of some GPUs:
+# a dataset the chart refuses is reported and skipped, the others are still timed.
+set -e
+
+EXEC=${EXEC:-bin/exec.out}
+SIZES=${BENCH_SIZES:-"1000x20 10000x100 100000x1000 1000000x100"}
+FRAMES=${BENCH_FRAMES:-600}
+WIDTH=${BENCH_WIDTH:-1280}
+HEIGHT=${BENCH_HEIGHT:-720}
+OUT=${BENCH_DIR:-bin/bench}
+
+# the software rasterizer when it is installed, so that the results do not depend on the GPU
+if [ -z "$VK_ICD_FILENAMES" ] && [ -z "$VK_DRIVER_FILES" ]; then
+    for icd in /usr/share/vulkan/icd.d/lvp_icd*.json; do
+        if [ -f "$icd" ]; then
+            VK_ICD_FILENAMES="$icd"
+            VK_DRIVER_FILES="$icd"
+            export VK_ICD_FILENAMES VK_DRIVER_FILES
+            echo "Vulkan driver: $icd"
+            break
+        fi
+    done
+fi
+
+mkdir -p "$OUT"
+for size in $SIZES; do
+    rows=${size%x*}
+    columns=${size#*x}
+    data="$OUT/data-$size.csv"
+    coordinates="$OUT/coordinates-$size.csv"
+
+    # a label and columns values per row, each series growing by a random step
+    if [ ! -f "$data" ]; then
+        awk -v rows="$rows" -v columns="$columns" 'BEGIN {
+            srand(1)
+            line = "Line"
+            for (j = 1; j <= columns; j++) line = line ",s" j
+            print line
+            for (i = 1; i <= rows; i++) {
+                line = i
+                for (j = 1; j <= columns; j++) {
+                    value[j] += int(rand() * 100)
+                    line = line "," value[j]
+                }
+                print line
+            }
+        }' > "$data"
+    fi
+    # one place per series, inside the bundled map (the default map of the menu)
+    if [ ! -f "$coordinates" ]; then
+        awk -v columns="$columns" 'BEGIN {
+            srand(2)
+            print "Code,Name,Latitude,Longitude"
+            for (j = 1; j <= columns; j++) {
+                printf "%d,s%d,%.6f,%.6f\n", j, j, 34.5 + rand() * 13, 5 + rand() * 15
+            }
+        }' > "$coordinates"
+    fi
+
+    for mode in barChart barChartMap; do
+        name="$OUT/$mode-$size"
+        echo "== $mode, $rows rows x $columns columns"
+        if ! "$EXEC" --bench --mode "$mode" --title "$mode $size" --csv_data "$data" --csv_coordinates "$coordinates" \
+            --frames "$FRAMES" --width "$WIDTH" --height "$HEIGHT" --profile "$name.csv" > "$name.log"; then
+            echo "skipped: the chart could not be drawn"
+            continue
+        fi
+        sed -n '/^Benchmark/,$p' "$name.log"
+    done
+done
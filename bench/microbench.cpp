@@ -0,0 +1,201 @@
+// Times the CPU side of the charts alone, without Vulkan or GLFW: parsing the CSV files, their statistics,
+// the Mercator projection of the coordinates, the font atlas and the layout of the texts, on generated inputs
+// of growing size.
+// Run by "make microbench"; the CSV files are generated in the directory given as argument.
+
+#include "CSVReader.hpp"
+#include "FontAtlas.hpp"
+
+extern "C" {
+    #include "mercator.h"
+}
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <cstdio>
+#include <sys/stat.h>
+
+namespace {
+
+// Each measure is repeated until it took at least this long, its time is the mean of the repetitions
+const double MIN_SECONDS = 0.5;
+
+// Whatever the measured code returns goes here, so that the compiler cannot drop it
+volatile double sink;
+
+template <class F>
+double secondsPerRun(F run) {
+    int runs = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed;
+    do {
+        run();
+        runs++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS);
+    return elapsed / runs;
+}
+
+// amount of unit processed by each run, a second throughput is printed if unit2 is given
+void report(const char *name, const std::string &input, double seconds, double amount, const char *unit,
+            double amount2 = 0, const char *unit2 = NULL) {
+    printf("%-24s %-22s %12.3f ms %14.0f %s/s", name, input.c_str(), seconds * 1e3, amount / seconds, unit);
+    if (unit2) {
+        printf(" %14.0f %s/s", amount2 / seconds, unit2);
+    }
+    printf("\n");
+}
+
+// rows lines of columns values after a label, as the data files of the charts
+std::string writeCSV(const std::string &directory, int rows, int columns) {
+    std::string fileName = directory + "/data-" + std::to_string(rows) + "x" + std::to_string(columns) + ".csv";
+    struct stat st;
+    if (stat(fileName.c_str(), &st) == 0) {
+        return fileName;
+    }
+    std::ofstream file(fileName);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> step(0.0f, 100.0f);
+    std::vector<float> values(columns, 0.0f);
+    file << "Date";
+    for (int j = 0; j < columns; j++) {
+        file << ",series " << j;
+    }
+    file << "\n";
+    for (int i = 0; i < rows; i++) {
+        file << "2020-01-01 " << i;
+        for (int j = 0; j < columns; j++) {
+            values[j] += step(random);
+            file << "," << values[j];
+        }
+        file << "\n";
+    }
+    return fileName;
+}
+
+void benchCSV(const std::string &directory, int rows, int columns) {
+    std::string fileName = writeCSV(directory, rows, columns);
+    std::string input = std::to_string(rows) + " x " + std::to_string(columns);
+    struct stat st;
+    stat(fileName.c_str(), &st);
+    double megabytes = st.st_size / 1e6;
+
+    // the text is parsed every time (readData), the snapshot is only read back
+    double seconds = secondsPerRun([&] {
+        CSVReader csv(fileName, ',', false);
+        sink = csv.getNumLines();
+    });
+    report("CSVReader parse", input, seconds, megabytes, "MB", rows, "rows");
+
+    CSVReader(fileName, ',', true);
+    seconds = secondsPerRun([&] {
+        CSVReader csv(fileName, ',', true);
+        sink = csv.getNumLines();
+    });
+    report("CSVReader snapshot", input, seconds, rows, "rows");
+
+    // the reduction done at load, over the columns of the file (the labels included, as at load); the
+    // maximum values are then read from its results, without going through the values again
+    CSVReader csv(fileName, ',', true);
+    int numVariables = csv.getNumVariables();
+    std::vector<CSVReader::ColumnStats> stats(numVariables);
+    seconds = secondsPerRun([&] {
+        CSVReader::computeStats(csv.getColumn(0).begin(), csv.getNumLines(), numVariables, stats.data());
+        sink = stats[numVariables - 1].max;
+    });
+    report("computeStats", input, seconds, (double)csv.getNumLines() * numVariables, "values");
+}
+
+void benchMercator(int points) {
+    std::mt19937 random(2);
+    std::uniform_real_distribution<double> latitude(-80.0, 80.0), longitude(-180.0, 180.0);
+    std::vector<double> latitudes(points), longitudes(points);
+    for (int i = 0; i < points; i++) {
+        latitudes[i] = latitude(random);
+        longitudes[i] = longitude(random);
+    }
+    std::string input = std::to_string(points) + " points";
+
+    double seconds = secondsPerRun([&] {
+        double total = 0;
+        for (int i = 0; i < points; i++) {
+            total += degreeLatitudeToY(latitudes[i]) + degreeLongitudeToX(longitudes[i]);
+        }
+        sink = total;
+    });
+    report("mercator to x, y", input, seconds, points, "points");
+
+    seconds = secondsPerRun([&] {
+        double total = 0;
+        for (int i = 0; i < points; i++) {
+            total += yToDegreeLatitude(latitudes[i] * 1e5) + xToDegreeLongitude(longitudes[i] * 1e5);
+        }
+        sink = total;
+    });
+    report("mercator to lat, lon", input, seconds, points, "points");
+}
+
+const char *FONT_FILE = "fonts/liberation-fonts-ttf-2.00.1/LiberationMono-Bold.ttf";
+
+// rasterized every time, as on the first run of the charts (then read back from its cache)
+void benchFontAtlas() {
+    double seconds = secondsPerRun([&] {
+        FontAtlas atlas(FONT_FILE, 48, false);
+        sink = atlas.getHeight();
+    });
+    report("FontAtlas generate", "95 glyphs", seconds, FontAtlas::NUM_CHARS, "glyphs");
+}
+
+void benchTextLayout(const GlyphTable &font, int texts, int lineLength) {
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> character(32, 126);
+    std::vector<std::string> lines(texts * 4);
+    for (std::string &line : lines) {
+        for (int c = 0; c < lineLength; c++) {
+            line += (char)character(random);
+        }
+    }
+    std::vector<SingleText> Texts(texts);
+    for (int t = 0; t < texts; t++) {
+        Texts[t].usedLines = 4;
+        for (int i = 0; i < 4; i++) {
+            Texts[t].l[i] = lines[t * 4 + i].c_str();
+        }
+    }
+    double glyphs = (double)texts * 4 * lineLength;
+    std::string input = std::to_string(texts) + " texts x 4 x " + std::to_string(lineLength);
+
+    std::vector<TextVertex> vertices;
+    std::vector<uint32_t> indices;
+    double seconds = secondsPerRun([&] {
+        vertices.clear();
+        layoutText(Texts, font, vertices, indices);
+        sink = vertices.size();
+    });
+    report("createTextMesh", input, seconds, glyphs, "glyphs");
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    std::string directory = argc > 1 ? argv[1] : ".";
+
+    printf("%-24s %-22s %15s %16s\n", "", "input", "time", "throughput");
+    const int sizes[][2] = {{1000, 20}, {10000, 100}, {100000, 100}, {100000, 1000}};
+    for (const int *size : sizes) {
+        benchCSV(directory, size[0], size[1]);
+    }
+    for (int points = 1000; points <= 1000000; points *= 10) {
+        benchMercator(points);
+    }
+    benchFontAtlas();
+    FontAtlas atlas(FONT_FILE);
+    GlyphTable font = atlas.getGlyphTable(FontSizes[1]);
+    for (int texts = 1; texts <= 1000; texts *= 10) {
+        benchTextLayout(font, texts, 40);
+    }
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include "legend.hpp"
+#include "Profiler.hpp"
 #include <stdexcept>
 #include <thread>
+#include <cfloat>
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui/imgui_impl_opengl3.h>
@@ -64,6 +66,11 @@ Legend::Legend(GLFWwindow* parentWindow)
     (void)io; // Prevents unused variable warning
     ImGui_ImplGlfw_InitForOpenGL(childWindow, true);
     ImGui_ImplOpenGL3_Init("#version 130");
+
+    // the chart has its own vertical sync: waiting for another one would halve its frame rate
+    glfwSwapInterval(0);
+    lastRefresh = -1.0 / REFRESH_RATE;
+    snapshot = nullptr;
 }
 
 Legend::~Legend() {
@@ -91,19 +98,25 @@ Legend & Legend::getInstance() {
     return *instance;
 }
 
-void Legend::setLegend(std::vector<std::string> names, std::vector<glm::vec3> colors) {
+void Legend::setLegend(const std::vector<std::string> &names, const std::vector<glm::vec3> &colors) {
     assert(names.size() == colors.size() && "names and colors must be the same size");
     this->names = names;
     this->colors = colors;
 }
 
-void Legend::setValues(std::vector<float> values) {
-    assert(names.size() == values.size() && "names and values must be the same size");
-    this->values = values;
+void Legend::setSnapshot(LegendSnapshot *snapshot) {
+    this->snapshot = snapshot;
 }
 
-void Legend::setTime(std::string time) {
-    this->time = time;
+void Legend::refresh() {
+    double now = glfwGetTime();
+    if(now - lastRefresh < 1.0 / REFRESH_RATE) {
+        return;
+    }
+    lastRefresh = now;
+    if(snapshot)
+        snapshot->update();
+    mainLoop();
 }
 
 void Legend::mainLoop() {
@@ -144,12 +157,31 @@ void Legend::mainLoop() {
     window_height = ImGui::GetWindowSize().y;
     glfwSetWindowSize(instance->childWindow, window_width, window_height);
 
-    ImGui::Text("%s", time.c_str());
+    // without a snapshot, or before the first one is published, the names alone
+    const LegendValues *shown = snapshot ? &snapshot->front() : nullptr;
+    ImGui::Text("%s", shown ? shown->time : "");
     ImGui::Separator();
     for(int i = 0; i < names.size(); i++) {
         ImGui::TextColored(ImVec4(colors[i].x, colors[i].y, colors[i].z, 1.0f), u8"██");
         ImGui::SameLine();
-        ImGui::Text("  %s:  %.2f", names[i].c_str(), values[i]);
+        if(shown && i < shown->values.size())
+            ImGui::Text("  %s:  %.2f", names[i].c_str(), shown->values[i]);
+        else
+            ImGui::Text("  %s", names[i].c_str());
+    }
+
+    // the last times of each part of the frame, with the mean of those and the 95th percentile of the whole run
+    if(ImGui::CollapsingHeader("Profiler")) {
+        Profiler &profiler = Profiler::getInstance();
+        const std::vector<Profiler::Section> &sections = profiler.getSections();
+        for(int i = 0; i < sections.size(); i++) {
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "%.2f ms, p95 %.2f ms", profiler.getRecentMean(i), profiler.getPercentile(i, 0.95f));
+            ImGui::Text("%s", sections[i].name.c_str());
+            ImGui::PushID(i);
+            ImGui::PlotHistogram("##history", sections[i].history.data(), Profiler::HISTORY, sections[i].next, overlay, 0.0f, FLT_MAX, ImVec2(0, 30));
+            ImGui::PopID();
+        }
     }
 
     ImGui::End();
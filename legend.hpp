@@ -2,16 +2,32 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include <GLFW/glfw3.h>
+#include "TripleBuffer.hpp"
+
+// What the legend shows, written by the chart: the slots are sized once, then rewritten in place
+// (see Legend::setSnapshot), so that updating the legend never allocates
+struct LegendValues {
+    std::vector<float> values;
+    char time[128];
+};
+typedef TripleBuffer<LegendValues> LegendSnapshot;
 
 class Legend {
 public:
     static Legend & getInstance(GLFWwindow* parentWindow);
     static Legend & getInstance();
-    void mainLoop();
-    void setLegend(std::vector<std::string> names, std::vector<glm::vec3> colors);
-    void setValues(std::vector<float> values);
-    void setTime(std::string time);
+    // Draws the legend again if it is due: it refreshes at most REFRESH_RATE times a second, whatever the
+    // frame rate of the chart, and never waits for the vertical sync
+    void refresh();
+    // set once, before the first refresh
+    void setLegend(const std::vector<std::string> &names, const std::vector<glm::vec3> &colors);
+    // The values and the time are read from snapshot, owned by the chart: it writes them in its back slot
+    // and publishes them, the legend shows the last published ones from its next refresh
+    void setSnapshot(LegendSnapshot *snapshot);
+
+    static constexpr double REFRESH_RATE = 30.0;
 protected:
+
     Legend(GLFWwindow* parentWindow);
     ~Legend();
     static Legend* instance;
@@ -19,8 +35,10 @@ protected:
     GLFWwindow* childWindow;
     std::vector<std::string> names;
     std::vector<glm::vec3> colors;
-    std::vector<float> values;
-    std::string time;
+    LegendSnapshot *snapshot;
+    double lastRefresh;
+
+    void mainLoop();
 
     static int cursorX, cursorY, deltaCursorX, deltaCursorY, windowPosX, windowPosY;
     static bool isMoved;
@@ -1,39 +1,74 @@
 #include "CSVReader.hpp"
+#include "CSVStream.hpp"
 #include "BarChart.hpp"
 #include "BarChartMap.hpp"
 #include "menu.hpp"
+#include "Profiler.hpp"
+
+#include <memory>
 
 
 int main(int argc, char* argv[])
 {
 
-	struct menuData * data = menu();
+	// with arguments (e.g. to render snapshots on a server) the menu is not shown
+	struct menuData * data = argc > 1 ? readOptions(argc, argv) : menu();
 
+	if(data == NULL) {
+		return EXIT_FAILURE;
+	}
 	if(data->closed) {
 		delete data;
 		return EXIT_SUCCESS;
 	}
 
-	CSVReader csv(data->csv_data);
-
-
-	BaseProject *app;
 	std::string executablePath = argv[0];
 	std::string executableDir = executablePath.substr(0, executablePath.find_last_of("\\/"));
 	std::string shaderDir = executableDir + "/shaders/";
 
-	if(data->mode == "barChartMap") {
-		CSVReader csv_coordinates(data->csv_coordinates);
-		app = new BarChartMap(data->title, shaderDir, csv, csv_coordinates, data->latitude_column, data->longitude_column, data->up, data->left, data->right, data->down, data->zoom, data->map, data->gridDim);
-	} else if(data->mode == "barChart") {
-		app = new BarChart(data->title, shaderDir, csv, data->gridDim);
+	// released on every exit, the app first (it reads the source), which stops the reader of a live source
+	std::unique_ptr<DataSource> csv;
+	std::unique_ptr<BarChart> app;
+	try {
+		if(data->live)
+			csv.reset(new CSVStream(data->csv_data));
+		else
+			csv.reset(new CSVReader(data->csv_data));
+
+		if(data->mode == "barChartMap") {
+			CSVReader csv_coordinates(data->csv_coordinates);
+			app.reset(new BarChartMap(data->title, shaderDir, *csv, csv_coordinates, data->latitude_column, data->longitude_column, data->up, data->left, data->right, data->down, data->zoom, data->map, data->gridDim));
+		} else if(data->mode == "barChart") {
+			app.reset(new BarChart(data->title, shaderDir, *csv, data->gridDim));
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		delete data;
+		return EXIT_FAILURE;
 	}
 
+	bool headless = data->headless;
+	bool bench = data->bench;
+	int width = data->width, height = data->height, frames = data->frames;
+	std::string output = data->output;
+	std::string exportPattern = data->export_pattern;
+	float fps = data->fps;
+	std::string profile = data->profile;
+	app->setSnapshotLine(data->line);
 	delete data;
 
     try {
-        app->run();
-		delete app;
+		if(bench)
+			app->runBenchmark(width, height, frames);
+		else if(!exportPattern.empty())
+			app->runExport(width, height, frames, fps, exportPattern);
+		else if(headless)
+			app->runHeadless(width, height, frames, output);
+		else
+			app->run();
+		// the timings of the whole run
+		if(!profile.empty() && !Profiler::getInstance().save(profile))
+			std::cerr << "failed to write " << profile << std::endl;
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
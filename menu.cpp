@@ -6,15 +6,29 @@
 
 #include <imgui/ImGuiFileDialog.h>
 
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
 int selected_radio_button = 2;
 std::string title="Cases by region" ,mode="barChartMap", csv_data = "data/cases_by_region.csv", csv_coordinates = "data/region_coordinates.csv", map = "textures/map-47.5-20-34.5-5.png";
 int latitude_column=2, longitude_column=3;
 float up=47.5f, down=34.5f, left=5.f, right=20.f, zoom=0.00002f;
 float gridDim = 10000;
+bool live = false;
+bool run_headless = false;
+int snapshot_width = 1280, snapshot_height = 720, snapshot_frames = 1, snapshot_line = -1;
+std::string snapshot_output = "chart.png";
+std::string export_pattern = "";
+float export_fps = 30.f;
+bool run_bench = false;
+std::string profile_output = "";
 
 bool isOk = false;
 int window_width, window_height;
 
+menuData* newMenuData(bool closed);
+
 menuData* menu() {
     bool closed = false;
     // Initialize GLFW
@@ -63,11 +77,17 @@ menuData* menu() {
 
     isOk = false;
 
+    return newMenuData(closed);
+
+}
+
+menuData* newMenuData(bool closed) {
     struct menuData * data = new menuData;
     data->closed = closed;
     data->title = title;
     data->mode = mode;
     data->csv_data = csv_data;
+    data->live = live;
     data->csv_coordinates = csv_coordinates;
     data->map = map;
     data->latitude_column = latitude_column;
@@ -78,9 +98,107 @@ menuData* menu() {
     data->right = right;
     data->zoom = zoom;
     data->gridDim = gridDim;
+    data->headless = run_headless;
+    data->width = snapshot_width;
+    data->height = snapshot_height;
+    data->frames = snapshot_frames;
+    data->line = snapshot_line;
+    data->output = snapshot_output;
+    data->export_pattern = export_pattern;
+    data->fps = export_fps;
+    data->bench = run_bench;
+    data->profile = profile_output;
 
     return data;
+}
+
+// Sets one parameter from its text, returns false if the name or the value is wrong
+bool setOption(const std::string &name, const std::string &value) {
+    std::istringstream in(value);
+    bool ok;
+    if(name == "title") { title = value; return true; }
+    else if(name == "mode") { mode = value; return mode == "barChart" || mode == "barChartMap"; }
+    else if(name == "csv_data") { csv_data = value; return true; }
+    else if(name == "csv_coordinates") { csv_coordinates = value; return true; }
+    else if(name == "map") { map = value; return true; }
+    else if(name == "output") { snapshot_output = value; return true; }
+    else if(name == "export_pattern") { export_pattern = value; return true; }
+    else if(name == "profile") { profile_output = value; return true; }
+    else if(name == "live") ok = (bool)(in >> live);
+    else if(name == "headless") ok = (bool)(in >> run_headless);
+    else if(name == "bench") ok = (bool)(in >> run_bench);
+    else if(name == "latitude_column") ok = (bool)(in >> latitude_column);
+    else if(name == "longitude_column") ok = (bool)(in >> longitude_column);
+    else if(name == "up") ok = (bool)(in >> up);
+    else if(name == "down") ok = (bool)(in >> down);
+    else if(name == "left") ok = (bool)(in >> left);
+    else if(name == "right") ok = (bool)(in >> right);
+    else if(name == "zoom") ok = (bool)(in >> zoom);
+    else if(name == "gridDim") ok = (bool)(in >> gridDim);
+    else if(name == "width") ok = (bool)(in >> snapshot_width) && snapshot_width > 0;
+    else if(name == "height") ok = (bool)(in >> snapshot_height) && snapshot_height > 0;
+    else if(name == "frames") ok = (bool)(in >> snapshot_frames) && snapshot_frames > 0;
+    else if(name == "line") ok = (bool)(in >> snapshot_line);
+    else if(name == "fps") ok = (bool)(in >> export_fps) && export_fps > 0;
+    else return false;
+    return ok;
+}
+
+bool readConfig(const std::string &fileName) {
+    std::ifstream file(fileName);
+    if(!file) {
+        std::cerr << "Cannot open " << fileName << std::endl;
+        return false;
+    }
+    std::string text;
+    int n = 0;
+    while(std::getline(file, text)) {
+        n++;
+        // blank lines and comments are skipped
+        size_t begin = text.find_first_not_of(" \t\r");
+        if(begin == std::string::npos || text[begin] == '#') {
+            continue;
+        }
+        size_t equal = text.find('=', begin);
+        size_t nameEnd = text.find_last_not_of(" \t", equal == std::string::npos ? std::string::npos : equal - 1);
+        size_t valueBegin = equal == std::string::npos ? std::string::npos : text.find_first_not_of(" \t", equal + 1);
+        size_t valueEnd = text.find_last_not_of(" \t\r");
+        std::string name = text.substr(begin, nameEnd + 1 - begin);
+        std::string value = valueBegin == std::string::npos || valueBegin > valueEnd ? "" : text.substr(valueBegin, valueEnd + 1 - valueBegin);
+        if(equal == std::string::npos || !setOption(name, value)) {
+            std::cerr << fileName << ":" << n << ": wrong parameter \"" << text << "\"" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
 
+menuData* readOptions(int argc, char* argv[]) {
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "--headless") {
+            run_headless = true;
+            continue;
+        }
+        if(arg == "--bench") {
+            run_bench = true;
+            continue;
+        }
+        if(arg.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+            std::cerr << "Wrong argument " << arg << ", expected --headless, --bench, --config <file> or --<name> <value>" << std::endl;
+            return NULL;
+        }
+        std::string value = argv[++i];
+        if(arg == "--config") {
+            if(!readConfig(value)) {
+                return NULL;
+            }
+        } else if(!setOption(arg.substr(2), value)) {
+            std::cerr << "Wrong parameter " << arg << " " << value << std::endl;
+            return NULL;
+        }
+    }
+    return newMenuData(false);
 }
 
 void mainLoop(GLFWwindow *window) {
@@ -167,6 +285,17 @@ void barChartMenu() {
     }
     ImGui::Spacing();
 
+    // live data keeps coming from a growing file, a named pipe, a UNIX socket or the standard input ("-")
+    ImGui::Checkbox("Live data", &live);
+    if(live) {
+        char path[1024];
+        strncpy(path, csv_data.c_str(), sizeof(path) - 1);
+        path[sizeof(path) - 1] = '\0';
+        ImGui::InputText("Source", path, sizeof(path));
+        csv_data = path;
+    }
+    ImGui::Spacing();
+
     ImGui::InputFloat("Grid dimension", &gridDim, 0.0f, 0.0f, "%.6f");
     ImGui::Spacing();
 }
@@ -6,6 +6,7 @@ struct menuData {
     std::string title;
     std::string mode;
     std::string csv_data;
+    bool live;
     std::string csv_coordinates;
     std::string map;
     int latitude_column;
@@ -16,12 +17,32 @@ struct menuData {
     float right;
     float zoom;
     float gridDim;
+    // rendering without a window (see BaseProject::runHeadless)
+    bool headless;
+    int width;
+    int height;
+    int frames;
+    int line;
+    std::string output;
+    // with a file name pattern (e.g. "frame%05d.png"), frames frames of the animation are saved instead
+    std::string export_pattern;
+    float fps;
+    // frames frames are drawn without a window and timed instead (see BaseProject::runBenchmark)
+    bool bench;
+    // file where the frame timings are saved at exit (see Profiler::save), none if empty
+    std::string profile;
 };
 
 /// TODO: maybe make this a class
 
 menuData* menu();
 
+// The same parameters without the menu: "--name value" arguments, named as the fields of menuData,
+// "--config file" for a file of "name = value" lines, "--headless" to render a snapshot without a window,
+// "--bench" to time the rendering without a window.
+// Returns NULL (after printing why) if an argument is wrong.
+menuData* readOptions(int argc, char* argv[]);
+
 void mainLoop(GLFWwindow* window);
 
 void barChartMenu();
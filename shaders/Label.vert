@@ -0,0 +1,55 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// All the glyphs of all the labels in one draw: the unit quad, placed by its instance data.
+// The anchor of the label is projected, the glyph is then moved from there in pixels: facing the camera,
+// of the same size at any distance
+
+layout(set = 0, binding = 1) uniform LabelUniformBufferObject {
+	vec2 pixelSize;
+	float lift;
+} lubo;
+
+// the bars, as in ShaderBarInstanced.vert
+layout(set = 1, binding = 0) uniform UniformBufferObject {
+	mat4 mvpMat;
+	int prevRow;	// -1: the bars grow from zero
+	int row;
+	float blend;
+	float scalingFactor;
+	float minHeight;
+	int numBars;
+} ubo;
+
+layout(std430, set = 1, binding = 1) readonly buffer Values {
+	float values[];
+};
+
+layout(location = 0) in vec2 inCorner;
+
+layout(location = 1) in vec3 inAnchor;
+layout(location = 2) in int inBar;
+layout(location = 3) in vec2 inOffset;
+layout(location = 4) in vec2 inSize;
+layout(location = 5) in vec4 inUV;
+
+layout(location = 0) out vec2 fragTexCoord;
+
+float value(int row) {
+	float v = row < 0 ? 0.0 : values[row * ubo.numBars + inBar];
+	return isnan(v) ? 0.0 : v;
+}
+
+void main() {
+	vec3 anchor = inAnchor;
+	if (inBar >= 0) {
+		anchor.y += mix(value(ubo.prevRow), value(ubo.row), ubo.blend) * ubo.scalingFactor + ubo.minHeight;
+	}
+	anchor.y += lubo.lift;
+	vec4 pos = ubo.mvpMat * vec4(anchor, 1.0);
+	// in clip space, before the division by w
+	pos.xy += (inOffset + inCorner * inSize) * lubo.pixelSize * pos.w;
+	gl_Position = pos;
+
+	fragTexCoord = mix(inUV.xy, inUV.zw, inCorner);
+}
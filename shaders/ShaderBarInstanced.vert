@@ -0,0 +1,44 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// All the bars in one draw: the mesh of a unit bar, placed by its instance data
+// and scaled to the value of its series, interpolated between two lines
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+	mat4 mvpMat;
+	int prevRow;	// -1: the bars grow from zero
+	int row;
+	float blend;
+	float scalingFactor;
+	float minHeight;
+	int numBars;
+} ubo;
+
+// the whole series: numBars values per row
+layout(std430, set = 0, binding = 1) readonly buffer Values {
+	float values[];
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 2) in vec3 inBarPosition;
+layout(location = 3) in vec3 inBarColor;
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec3 outColor;
+
+// cells that are not numbers are shown as zero
+float value(int row) {
+	float v = row < 0 ? 0.0 : values[row * ubo.numBars + gl_InstanceIndex];
+	return isnan(v) ? 0.0 : v;
+}
+
+void main() {
+	float height = mix(value(ubo.prevRow), value(ubo.row), ubo.blend) * ubo.scalingFactor + ubo.minHeight;
+	vec3 pos = inBarPosition + vec3(inPosition.x, inPosition.y * height, inPosition.z);
+	gl_Position = ubo.mvpMat * vec4(pos, 1.0);
+
+	outNormal = inNormal;
+	outColor = inBarColor;
+}
@@ -3,10 +3,12 @@
 
 layout(location = 0) in vec3 inNormal;
 layout(location = 1) in vec2 inUV;
+layout(location = 2) flat in int inLayer;
 
 layout(location = 0) out vec4 outColor;
 
-layout(set = 0, binding = 1) uniform sampler2D tex;
+// the tiles of the map, a layer each
+layout(set = 0, binding = 1) uniform sampler2DArray tex;
 
 layout(set = 1, binding = 0) uniform GlobalUniformBlock {
     vec3 DlightDir;
@@ -58,7 +60,7 @@ void main() {
     vec3 ambient = gubo.AmbLightColor;
 
     // Combine ambient, diffuse, and specular lighting
-    vec3 finalColor = clamp(texture(tex, inUV).rgb * (ambient + directDiffuse) + directSpecular, 0.0f, 1.0f);
+    vec3 finalColor = clamp(texture(tex, vec3(inUV, inLayer)).rgb * (ambient + directDiffuse) + directSpecular, 0.0f, 1.0f);
 
     outColor = vec4(finalColor, 1.0f);    // Final color with lighting
 }
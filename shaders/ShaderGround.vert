@@ -5,26 +5,22 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 	mat4 mvpMat;
 } ubo;
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inUV;
+// a corner of the unit quad, moved on the tile of the map drawn by this instance
+layout(location = 0) in vec2 inCorner;
+layout(location = 1) in vec4 inRect;	// x and z of the corners of the tile on the ground
+layout(location = 2) in vec4 inUV;		// of the same corners in the layer
+layout(location = 3) in int inLayer;
 
 layout(location = 0) out vec3 outNormal;
 layout(location = 1) out vec2 outUV;
+layout(location = 2) flat out int outLayer;
 
 void main() {
-	// float x = inPosition.x;
-	// float y = inPosition.y;
-	// float z = inPosition.z;
+	// u (inCorner.x) runs along z, v along x
+	vec3 pos = vec3(mix(inRect.x, inRect.z, inCorner.y), -0.1, mix(inRect.y, inRect.w, inCorner.x));
+	gl_Position = ubo.mvpMat * vec4(pos, 1.0);
 
-	// mat4 scaleMat = mat4(1);
-	// //scaleMat[1][1] = ubo.height;
-
-	// // Create a translation matrix
-	// vec3 vpos = vec3(x, y, z);
-	// gl_Position =  scaleMat  * ubo.mvpMat * vec4(vpos, 1);
-	gl_Position = ubo.mvpMat * vec4(inPosition, 1.0);
-
-	outNormal = inNormal;
-	outUV = inUV;
-}
\ No newline at end of file
+	outNormal = vec3(0.0, 1.0, 0.0);
+	outUV = mix(inUV.xy, inUV.zw, inCorner);
+	outLayer = inLayer;
+}
@@ -6,23 +6,24 @@ layout(location = 0) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+// Distance field atlas (see FontAtlas): 0.5 on the outline of the glyphs, 1/16 more per pixel of the
+// atlas inside, less outside
+const float EDGE = 0.5;
+const float OUTLINE = EDGE - 2.0 / 16.0;
+
 void main() {
-    vec4 Tx;
-    Tx = texture(texSampler, fragTexCoord);
-    
-    float value0 = Tx[0];
+    float dist = texture(texSampler, fragTexCoord).r;
+    // about one pixel of the screen, whatever the size the text is drawn at
+    float smoothing = max(fwidth(dist), 1e-4);
+
     //Text Color
-    vec4 result = vec4(1.0, 1.0, 1.0, 1.0) * value0;
-    
-    float value1 = Tx[1];
-    //Outilne Color
-    vec4 factor1 = vec4(0.0, 0.0, 0.0, 1.0) * value1;
-    result = result + factor1;
-    
-    float value2 = Tx[2];
-    //Shadow Color
-    vec4 factor2 = vec4(0.0, 0.0, 0.0, 1.0) * value2;
-    result = result + factor2;
-    
-    outColor = result;
-}
\ No newline at end of file
+    float text = smoothstep(EDGE - smoothing, EDGE + smoothing, dist);
+    //Outline Color
+    float outline = smoothstep(OUTLINE - smoothing, OUTLINE + smoothing, dist);
+
+    // the empty parts of the quads must not hide what is drawn after them (the labels are in the scene)
+    if (outline <= 0.0) {
+        discard;
+    }
+    outColor = mix(vec4(0.0, 0.0, 0.0, outline), vec4(1.0, 1.0, 1.0, 1.0), text);
+}